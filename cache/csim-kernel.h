@@ -0,0 +1,82 @@
+/*
+ * csim-kernel.h - One geometry specialised access kernel for csim.c
+ *
+ * Included once per kernel by csim.c's Kernel section with KERNEL_WAYS and
+ * KERNEL_BLOCK_BITS defined, each inclusion defines
+ * lru_kernel_<ways>_<bits>. A kernel does what execute_operation_in_cache
+ * does for an LRU, write-back, write-allocate cache with no victim cache,
+ * but the associativity and block size are literals here: the set scan runs
+ * a fixed number of ways (none at all when direct mapped), the index and
+ * block size come from constant shifts, and there is no policy or write
+ * mode dispatch left on the path.
+ */
+
+#define KERNEL_CONCAT(ways, bits) lru_kernel_##ways##_##bits
+#define KERNEL_NAME(ways, bits) KERNEL_CONCAT(ways, bits)
+
+static void KERNEL_NAME(KERNEL_WAYS, KERNEL_BLOCK_BITS)(
+    cache_t *cache, operation_t operation, size_t address, size_t size,
+    access_result_t *result) {
+  // kept for the cache->kernel signature; a write-back cache moves whole
+  // blocks, so the access size never matters here
+  (void)size;
+  size_t set_index = (address >> KERNEL_BLOCK_BITS) & cache->set_mask;
+  size_t base = set_index * KERNEL_WAYS;
+  size_t *lines = cache->tags + base;
+  size_t key = line_tag(address >> cache->tag_shift);
+  bool is_write = operation != DATA_LOAD;
+  size_t way = 0;
+
+#if KERNEL_WAYS > 1
+  while (way < KERNEL_WAYS && lines[way] != key)
+    way++;
+#endif
+
+  if (way < KERNEL_WAYS && lines[way] == key) {
+    size_t index = base + way;
+    result->hit += operation == MODIFY ? 2 : 1;
+    if (cache->prefetched[index]) {
+      result->prefetch_hit += 1;
+      cache->prefetched[index] = 0;
+    }
+    cache->dirty[index] |= is_write;
+    cache->line_state[index] = ++cache->time;
+    return;
+  }
+
+  // the first free way, else the least recently used one
+  way = 0;
+#if KERNEL_WAYS > 1
+  const unsigned long long *stamps = cache->line_state + base;
+  for (size_t i = 0; i < KERNEL_WAYS; i++) {
+    if (lines[i] == INVALID_LINE) {
+      way = i;
+      break;
+    }
+    if (stamps[i] < stamps[way])
+      way = i;
+  }
+#endif
+
+  size_t index = base + way;
+  result->miss += 1;
+  result->hit += operation == MODIFY;
+  result->bytes_read += (size_t)1 << KERNEL_BLOCK_BITS;
+  if (lines[way] != INVALID_LINE) {
+    result->eviction += 1;
+    if (cache->dirty[index]) {
+      result->dirty_eviction += 1;
+      result->bytes_written += (size_t)1 << KERNEL_BLOCK_BITS;
+    }
+    if (cache->prefetched[index])
+      result->prefetch_evicted += 1;
+  }
+
+  lines[way] = key;
+  cache->dirty[index] = is_write;
+  cache->prefetched[index] = 0;
+  cache->line_state[index] = ++cache->time;
+}
+
+#undef KERNEL_NAME
+#undef KERNEL_CONCAT
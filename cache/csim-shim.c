@@ -0,0 +1,130 @@
+/*
+ * csim-shim.c - In-process access recording for libcsim, see csim-shim.h
+ *
+ * Each thread appends to its own buffer with no locking at all; only a full
+ * buffer takes the lock, once per CSIM_SHIM_BUFFER_SIZE accesses, to replay
+ * itself into the attached simulator. Accesses of one thread stay in
+ * program order. Those of different threads interleave a buffer at a time,
+ * which is as close as a shared cache gets without a global order.
+ */
+#define _POSIX_C_SOURCE 200809L
+
+#include "csim-shim.h"
+#include <pthread.h>
+#include <stdbool.h>
+#include <stdint.h>
+
+typedef struct shim_buffer {
+  size_t count;
+  bool registered; // the exit destructor knows about this thread
+  csim_access_t records[CSIM_SHIM_BUFFER_SIZE];
+} shim_buffer_t;
+
+static __thread shim_buffer_t thread_buffer;
+
+static pthread_mutex_t shim_lock = PTHREAD_MUTEX_INITIALIZER;
+static pthread_once_t shim_once = PTHREAD_ONCE_INIT;
+static pthread_key_t shim_key;
+static csim_t *shim_simulator;      // guarded by shim_lock
+static volatile bool shim_recording; // checked on every access
+
+static void drain(shim_buffer_t *buffer) {
+  pthread_mutex_lock(&shim_lock);
+  if (shim_simulator)
+    csim_access_records(shim_simulator, buffer->records, buffer->count);
+  pthread_mutex_unlock(&shim_lock);
+  buffer->count = 0;
+}
+
+// a thread that exits without flushing still gets its accesses counted
+static void drain_on_exit(void *buffer) {
+  if (((shim_buffer_t *)buffer)->count > 0)
+    drain(buffer);
+}
+
+static void create_key(void) { pthread_key_create(&shim_key, drain_on_exit); }
+
+static void register_buffer(shim_buffer_t *buffer) {
+  pthread_once(&shim_once, create_key);
+  pthread_setspecific(shim_key, buffer);
+  buffer->registered = true;
+}
+
+void csim_shim_attach(csim_t *sim) {
+  csim_shim_flush();
+  pthread_mutex_lock(&shim_lock);
+  shim_simulator = sim;
+  pthread_mutex_unlock(&shim_lock);
+}
+
+void csim_shim_start(void) { shim_recording = true; }
+
+void csim_shim_stop(void) {
+  shim_recording = false;
+  csim_shim_flush();
+}
+
+void csim_shim_record(csim_kind_t kind, const void *address, uint32_t size) {
+  if (!shim_recording)
+    return;
+
+  shim_buffer_t *buffer = &thread_buffer;
+  if (!buffer->registered)
+    register_buffer(buffer);
+  if (buffer->count == CSIM_SHIM_BUFFER_SIZE)
+    drain(buffer);
+
+  csim_access_t *record = &buffer->records[buffer->count++];
+  record->address = (uintptr_t)address;
+  record->size = size;
+  record->kind = kind;
+}
+
+void csim_shim_flush(void) {
+  if (thread_buffer.count > 0)
+    drain(&thread_buffer);
+}
+
+/*
+ * The entry points -fsanitize=thread instruments code with. Only plain loads
+ * and stores are recorded; function entry and exit are ignored, and atomics
+ * are not provided, so code using them must link the real libtsan instead.
+ */
+
+void __tsan_init(void) {}
+void __tsan_func_entry(void *caller) {}
+void __tsan_func_exit(void) {}
+
+#define SHIM_HOOKS(size)                                                      \
+  void __tsan_read##size(void *address) {                                     \
+    csim_shim_record(CSIM_LOAD, address, size);                               \
+  }                                                                           \
+  void __tsan_write##size(void *address) {                                    \
+    csim_shim_record(CSIM_STORE, address, size);                              \
+  }                                                                           \
+  void __tsan_unaligned_read##size(void *address) {                           \
+    csim_shim_record(CSIM_LOAD, address, size);                               \
+  }                                                                           \
+  void __tsan_unaligned_write##size(void *address) {                          \
+    csim_shim_record(CSIM_STORE, address, size);                              \
+  }                                                                           \
+  void __tsan_volatile_read##size(void *address) {                            \
+    csim_shim_record(CSIM_LOAD, address, size);                               \
+  }                                                                           \
+  void __tsan_volatile_write##size(void *address) {                           \
+    csim_shim_record(CSIM_STORE, address, size);                              \
+  }
+
+SHIM_HOOKS(1)
+SHIM_HOOKS(2)
+SHIM_HOOKS(4)
+SHIM_HOOKS(8)
+SHIM_HOOKS(16)
+
+void __tsan_read_range(void *address, unsigned long size) {
+  csim_shim_record(CSIM_LOAD, address, size);
+}
+
+void __tsan_write_range(void *address, unsigned long size) {
+  csim_shim_record(CSIM_STORE, address, size);
+}
@@ -0,0 +1,64 @@
+/*
+ * csim-shim.h - Feed a running program's memory accesses straight to csim
+ *
+ * An alternative to tracing under valgrind: accesses are recorded in the
+ * program itself, into a per-thread buffer that is drained into a libcsim
+ * simulator whenever it fills, so no trace file is written and the code
+ * under study runs at close to native speed.
+ *
+ * Accesses reach the shim in one of two ways:
+ *
+ *   macros        wrap the loads and stores of interest by hand,
+ *                 x = CSIM_READ(A[i][j]); CSIM_WRITE(B[j][i], x);
+ *   compiler      build the code under study with -fsanitize=thread (and
+ *                 without linking libtsan): every load and store it makes
+ *                 then calls the __tsan_* hooks in csim-shim.c
+ *
+ * Nothing is recorded until csim_shim_start, so set-up and checking code
+ * that happens to be instrumented stays out of the counts.
+ */
+
+#ifndef CSIM_SHIM_H
+#define CSIM_SHIM_H
+
+#include "libcsim.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#define CSIM_SHIM_BUFFER_SIZE 4096
+
+/* Drain recorded accesses into sim (NULL to drop them), flushes first */
+void csim_shim_attach(csim_t *sim);
+
+/* Record accesses between these two calls, stop flushes the caller */
+void csim_shim_start(void);
+void csim_shim_stop(void);
+
+void csim_shim_record(csim_kind_t kind, const void *address, uint32_t size);
+
+/* Drain the calling thread's buffer, other threads drain on exit */
+void csim_shim_flush(void);
+
+/* Each evaluates lvalue once, so CSIM_READ(a[i++]) records what it reads */
+#define CSIM_READ(lvalue)                                                     \
+  __extension__({                                                             \
+    __typeof__(lvalue) *csim_shim_address_ = &(lvalue);                       \
+    csim_shim_record(CSIM_LOAD, csim_shim_address_,                           \
+                     sizeof(*csim_shim_address_));                            \
+    *csim_shim_address_;                                                      \
+  })
+#define CSIM_WRITE(lvalue, value)                                             \
+  __extension__({                                                             \
+    __typeof__(lvalue) *csim_shim_address_ = &(lvalue);                       \
+    csim_shim_record(CSIM_STORE, csim_shim_address_,                          \
+                     sizeof(*csim_shim_address_));                            \
+    *csim_shim_address_ = (value);                                            \
+  })
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* CSIM_SHIM_H */
@@ -0,0 +1,363 @@
+/*
+ * csim-trace.c - Trace readers and writers shared by csim and its tools
+ *
+ * Traces are read straight out of an mmap of the file and decoded in one
+ * forward pass: no line is ever copied and no libc number parsing is
+ * involved. Decoded records are handed out in batches so the simulator loop
+ * never goes back to the reader per access.
+ *
+ * Input that cannot be mapped (pipes, FIFOs, stdin) is streamed through a
+ * fixed buffer instead: the decoders stop before an incomplete trailing
+ * record, and refill_stream moves that remainder to the front of the buffer
+ * and reads more behind it.
+ *
+ * Binary format: the 8 byte magic "CSIMTRC1" followed by one record per
+ * access:
+ *
+ *   byte 0   bits 0-1 operation, bits 2-7 size (0 = size follows as varint)
+ *   varint   zigzag encoded delta from the previous address of the same
+ *            stream (instruction fetches and data accesses are separate)
+ *
+ * Varints are little endian base 128. Typical records take 2-3 bytes
+ * against ~14 for a text line.
+ */
+#define _POSIX_C_SOURCE 200809L
+
+#include "csim-trace.h"
+#include <fcntl.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <sys/types.h>
+#include <unistd.h>
+
+#define HEX_INVALID 0xff
+#define BINARY_MAGIC "CSIMTRC1"
+#define BINARY_MAGIC_LENGTH 8
+#define BINARY_MAX_INLINE_SIZE 63
+
+static unsigned char hex_table[256];
+
+static void init_hex_table(void) {
+  memset(hex_table, HEX_INVALID, sizeof(hex_table));
+  for (int i = 0; i < 10; i++)
+    hex_table['0' + i] = i;
+  for (int i = 0; i < 6; i++) {
+    hex_table['a' + i] = 10 + i;
+    hex_table['A' + i] = 10 + i;
+  }
+}
+
+// keep the unconsumed bytes and read whatever is available after them
+static void refill_stream(trace_reader_t *reader) {
+  char *buffer = (char *)reader->data;
+  size_t left = reader->length - reader->position;
+
+  // the buffer is full yet holds no complete record, so no read can help
+  if (left == TRACE_STREAM_BUFFER_SIZE) {
+    fprintf(stderr, "malformed trace: a record longer than %d bytes\n",
+            TRACE_STREAM_BUFFER_SIZE);
+    exit(EXIT_FAILURE);
+  }
+
+  memmove(buffer, buffer + reader->position, left);
+  reader->position = 0;
+  reader->length = left;
+
+  ssize_t got = read(reader->fd, buffer + reader->length,
+                     TRACE_STREAM_BUFFER_SIZE - reader->length);
+  if (got < 0) {
+    perror("failed to read trace file");
+    exit(EXIT_FAILURE);
+  }
+  if (got == 0)
+    reader->at_eof = true;
+  reader->length += got;
+}
+
+void open_trace_reader(trace_reader_t *reader, const char *trace_file,
+                       trace_format_t format) {
+  init_hex_table();
+
+  if (!trace_file) {
+    fprintf(stderr, "no trace file given (-t or -T, \"-\" for stdin)\n");
+    exit(EXIT_FAILURE);
+  }
+
+  int fd = strcmp(trace_file, "-") == 0 ? STDIN_FILENO
+                                        : open(trace_file, O_RDONLY);
+  if (fd < 0) {
+    perror("failed to open trace file");
+    exit(EXIT_FAILURE);
+  }
+
+  struct stat st;
+  if (fstat(fd, &st) < 0) {
+    perror("failed to stat trace file");
+    exit(EXIT_FAILURE);
+  }
+
+  reader->format = format;
+  reader->position = 0;
+  reader->is_mapped = false;
+  reader->is_stream = false;
+  reader->at_eof = true;
+  reader->fd = -1;
+  reader->data = NULL;
+  reader->length = 0;
+  reader->last_address[0] = 0;
+  reader->last_address[1] = 0;
+
+  if (S_ISREG(st.st_mode)) {
+    reader->length = st.st_size;
+    if (reader->length > 0) {
+      void *data = mmap(NULL, reader->length, PROT_READ, MAP_PRIVATE, fd, 0);
+      if (data == MAP_FAILED) {
+        perror("failed to mmap trace file");
+        exit(EXIT_FAILURE);
+      }
+      posix_madvise(data, reader->length, POSIX_MADV_SEQUENTIAL);
+      reader->data = data;
+      reader->is_mapped = true;
+    }
+    if (fd != STDIN_FILENO)
+      close(fd);
+  } else {
+    char *buffer = malloc(TRACE_STREAM_BUFFER_SIZE);
+    if (!buffer) {
+      perror("trace buffer malloc failure");
+      exit(EXIT_FAILURE);
+    }
+    reader->data = buffer;
+    reader->is_stream = true;
+    reader->at_eof = false;
+    reader->fd = fd;
+    do
+      refill_stream(reader);
+    while (reader->length < BINARY_MAGIC_LENGTH && !reader->at_eof);
+  }
+
+  if (format == TRACE_BINARY) {
+    if (reader->length < BINARY_MAGIC_LENGTH ||
+        memcmp(reader->data, BINARY_MAGIC, BINARY_MAGIC_LENGTH) != 0) {
+      fprintf(stderr, "%s: not a binary trace\n", trace_file);
+      exit(EXIT_FAILURE);
+    }
+    reader->position = BINARY_MAGIC_LENGTH;
+  }
+}
+
+void close_trace_reader(trace_reader_t *reader) {
+  if (reader->is_mapped)
+    munmap((void *)reader->data, reader->length);
+  if (reader->is_stream) {
+    free((void *)reader->data);
+    if (reader->fd != STDIN_FILENO)
+      close(reader->fd);
+  }
+  reader->data = NULL;
+}
+
+static inline const char *next_line(const char *p, const char *end) {
+  const char *newline = memchr(p, '\n', end - p);
+  return newline ? newline + 1 : end;
+}
+
+static size_t read_text_batch(trace_reader_t *reader, trace_record_t *records,
+                              size_t capacity) {
+  const char *p = reader->data + reader->position;
+  const char *end = reader->data + reader->length;
+  size_t count = 0;
+
+  // more input may follow, so only decode up to the last complete line
+  if (!reader->at_eof) {
+    while (end > p && end[-1] != '\n')
+      end--;
+    // a line longer than the whole buffer is garbage, drop it
+    if (end == p && reader->length == TRACE_STREAM_BUFFER_SIZE)
+      end = reader->data + reader->length;
+  }
+
+  while (count < capacity && p < end) {
+    while (p < end && *p == ' ')
+      p++;
+    if (p == end)
+      break;
+
+    operation_t operation;
+    switch (*p) {
+    case 'I':
+      operation = INSTRUCTION_LOAD;
+      break;
+    case 'L':
+      operation = DATA_LOAD;
+      break;
+    case 'S':
+      operation = DATA_STORE;
+      break;
+    case 'M':
+      operation = MODIFY;
+      break;
+    default: // not a memory access (e.g. valgrind chatter)
+      p = next_line(p, end);
+      continue;
+    }
+    p++;
+
+    while (p < end && *p == ' ')
+      p++;
+
+    const char *digits = p;
+    size_t address = 0;
+    unsigned char digit;
+    while (p < end && (digit = hex_table[(unsigned char)*p]) != HEX_INVALID) {
+      address = (address << 4) | digit;
+      p++;
+    }
+    if (p == digits || p == end || *p != ',') {
+      p = next_line(p, end);
+      continue;
+    }
+    p++;
+
+    unsigned int size = 0;
+    while (p < end && (unsigned char)(*p - '0') < 10) {
+      size = size * 10 + (*p - '0');
+      p++;
+    }
+
+    records[count].address = address;
+    records[count].size = size;
+    records[count].operation = operation;
+    count++;
+
+    p = next_line(p, end);
+  }
+
+  reader->position = p - reader->data;
+  return count;
+}
+
+// decode one varint, returns NULL if the trace ends inside it
+static inline const unsigned char *
+read_varint(const unsigned char *p, const unsigned char *end, uint64_t *value) {
+  uint64_t result = 0;
+  int shift = 0;
+
+  while (p < end) {
+    if (shift >= 64) {
+      fprintf(stderr, "malformed binary trace: a varint over 64 bits\n");
+      exit(EXIT_FAILURE);
+    }
+    unsigned char byte = *p++;
+    result |= (uint64_t)(byte & 0x7f) << shift;
+    if (!(byte & 0x80)) {
+      *value = result;
+      return p;
+    }
+    shift += 7;
+  }
+
+  return NULL;
+}
+
+static size_t read_binary_batch(trace_reader_t *reader,
+                                trace_record_t *records, size_t capacity) {
+  const unsigned char *p =
+      (const unsigned char *)reader->data + reader->position;
+  const unsigned char *end =
+      (const unsigned char *)reader->data + reader->length;
+  size_t count = 0;
+
+  while (count < capacity && p < end) {
+    const unsigned char *record = p;
+    unsigned char header = *p++;
+    operation_t operation = header & 0x3;
+    uint64_t size = header >> 2;
+    uint64_t zigzag;
+
+    if ((size == 0 && !(p = read_varint(p, end, &size))) ||
+        !(p = read_varint(p, end, &zigzag))) {
+      // a truncated record is completed by the next refill, or dropped at
+      // the end of the trace
+      p = reader->at_eof ? end : record;
+      break;
+    }
+
+    int stream = operation != INSTRUCTION_LOAD;
+    int64_t delta = (int64_t)(zigzag >> 1) ^ -(int64_t)(zigzag & 1);
+    size_t address = reader->last_address[stream] + delta;
+    reader->last_address[stream] = address;
+
+    records[count].address = address;
+    records[count].size = size;
+    records[count].operation = operation;
+    count++;
+  }
+
+  reader->position = (const char *)p - reader->data;
+  return count;
+}
+
+size_t read_trace_batch(trace_reader_t *reader, trace_record_t *records,
+                        size_t capacity) {
+  for (;;) {
+    size_t count = reader->format == TRACE_BINARY
+                       ? read_binary_batch(reader, records, capacity)
+                       : read_text_batch(reader, records, capacity);
+
+    if (count > 0 || reader->at_eof)
+      return count;
+    refill_stream(reader);
+  }
+}
+
+void open_trace_writer(trace_writer_t *writer, const char *trace_file) {
+  writer->file = fopen(trace_file, "wb");
+  if (!writer->file) {
+    perror("failed to create binary trace");
+    exit(EXIT_FAILURE);
+  }
+
+  writer->last_address[0] = 0;
+  writer->last_address[1] = 0;
+  fwrite(BINARY_MAGIC, 1, BINARY_MAGIC_LENGTH, writer->file);
+}
+
+static inline unsigned char *write_varint(unsigned char *p, uint64_t value) {
+  while (value >= 0x80) {
+    *p++ = (value & 0x7f) | 0x80;
+    value >>= 7;
+  }
+  *p++ = value;
+  return p;
+}
+
+void write_trace_record(trace_writer_t *writer, const trace_record_t *record) {
+  unsigned char buffer[1 + 10 + 10];
+  unsigned char *p = buffer;
+
+  if (record->size > 0 && record->size <= BINARY_MAX_INLINE_SIZE) {
+    *p++ = (record->size << 2) | record->operation;
+  } else {
+    *p++ = record->operation;
+    p = write_varint(p, record->size);
+  }
+
+  int stream = record->operation != INSTRUCTION_LOAD;
+  int64_t delta = (int64_t)(record->address - writer->last_address[stream]);
+  writer->last_address[stream] = record->address;
+  p = write_varint(p, ((uint64_t)delta << 1) ^ (uint64_t)(delta >> 63));
+
+  fwrite(buffer, 1, p - buffer, writer->file);
+}
+
+void close_trace_writer(trace_writer_t *writer) {
+  if (fclose(writer->file) != 0) {
+    perror("failed to write binary trace");
+    exit(EXIT_FAILURE);
+  }
+  writer->file = NULL;
+}
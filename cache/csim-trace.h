@@ -0,0 +1,78 @@
+/*
+ * csim-trace.h - Trace readers and writers shared by csim and its tools
+ *
+ * Two on-disk formats are understood:
+ *
+ *   text    the valgrind lackey format (" L 7ff000388,8"), one access per line
+ *   binary  a compact format produced by trace2bin, see csim-trace.c
+ *
+ * Both are decoded straight out of an mmap of the file and handed out in
+ * batches of trace_record_t. Pipes, FIFOs and "-" (stdin) are instead
+ * streamed through a fixed size buffer, so memory use does not depend on
+ * the length of the trace.
+ */
+
+#ifndef CSIM_TRACE_H
+#define CSIM_TRACE_H
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdio.h>
+
+#define TRACE_BATCH_SIZE 4096
+#define TRACE_STREAM_BUFFER_SIZE (1 << 20)
+
+typedef enum operation {
+  INSTRUCTION_LOAD = 0,
+  DATA_LOAD = 1,
+  DATA_STORE = 2, // S
+  MODIFY = 3,
+} operation_t;
+
+typedef struct trace_record {
+  size_t address;
+  unsigned int size;
+  operation_t operation;
+} trace_record_t;
+
+typedef enum trace_format {
+  TRACE_TEXT = 0,
+  TRACE_BINARY = 1,
+} trace_format_t;
+
+typedef struct trace_reader {
+  trace_format_t format;
+  const char *data;
+  size_t length;
+  size_t position;
+  bool is_mapped; // data is an mmap of the file
+
+  // streamed input: data is a TRACE_STREAM_BUFFER_SIZE buffer holding the
+  // unconsumed bytes read so far from fd
+  bool is_stream;
+  bool at_eof;
+  int fd;
+
+  size_t last_address[2]; // binary delta base: [0] instructions, [1] data
+} trace_reader_t;
+
+typedef struct trace_writer {
+  FILE *file;
+  size_t last_address[2];
+} trace_writer_t;
+
+/* Open trace_file ("-" for stdin) in the given format, exits on failure */
+void open_trace_reader(trace_reader_t *reader, const char *trace_file,
+                       trace_format_t format);
+void close_trace_reader(trace_reader_t *reader);
+
+/* Decode up to capacity records, returns 0 once the trace is exhausted */
+size_t read_trace_batch(trace_reader_t *reader, trace_record_t *records,
+                        size_t capacity);
+
+/* Create a binary trace at trace_file, exits on failure */
+void open_trace_writer(trace_writer_t *writer, const char *trace_file);
+void write_trace_record(trace_writer_t *writer, const trace_record_t *record);
+void close_trace_writer(trace_writer_t *writer);
+
+#endif /* CSIM_TRACE_H */
@@ -1,403 +1,4461 @@
+#define _POSIX_C_SOURCE 200809L
+
 #include "cachelab.h"
+#include "csim-trace.h"
+#include "libcsim.h"
 #include <assert.h>
+#include <ctype.h>
 #include <getopt.h>
-#include <limits.h>
+#include <math.h>
+#include <pthread.h>
+#include <setjmp.h>
 #include <stdbool.h>
+#include <stdint.h>
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
 
+#if defined(__AVX2__) || defined(__SSE2__)
+#include <immintrin.h>
+#endif
+
 /*
-A block can be 2 numbers denoting the range [L, R]
-A line is a block, tag and valid bit
-A set is an array of lines
-A cache is an array of sets
-*/
+A line is a tag and a replacement state word
+A set is E consecutive lines plus one replacement state word
+A cache is 2^s sets
 
-unsigned long long global_time = 0;
+Lines are stored structure-of-arrays: the tags and states of every set live
+in flat arrays indexed by set * E + way, so probing a set touches one
+contiguous run of tags instead of chasing per-line pointers. A line stores
+tag + 1 and an invalid line 0, so validity needs no array of its own and a
+single pass over the tags finds both the hit and the first free way, E
+ways at a time with SSE2 or AVX2.
+*/
 
 typedef enum set_probe_result {
   PROBE_HIT = 0,
   PROBE_MISS = 1
 } set_probe_result_t;
 
-typedef enum operation {
-  INSTRUCTION_LOAD = 0,
-  DATA_LOAD = 1,
-  DATA_STORE = 2, // S
-  MODIFY = 3,
-} operation_t;
-
-// block logic Begin
-typedef struct block {
-  size_t l;
-  size_t r;
-} block_t;
+// Cache section start
 
-void flush_and_fetch_new_block(block_t *block, size_t new_l,
-                               size_t block_bits) {
-  block->l = new_l;
-  block->r = new_l + (1 << (block_bits+1));
-}
+typedef enum replacement_policy {
+  POLICY_LRU = 0,
+  POLICY_FIFO = 1,
+  POLICY_RANDOM = 2,
+  POLICY_PLRU = 3,  // tree pseudo-LRU, E must be a power of two <= 64
+  POLICY_SRRIP = 4, // static re-reference interval prediction, 2 bit RRPV
+  POLICY_BRRIP = 5, // bimodal RRIP, inserts at distant re-reference
+  POLICY_LFU = 6,
+} replacement_policy_t;
 
-block_t *construct_block() {
-  block_t *new_block = (block_t *)malloc(sizeof(block_t));
+static const char *policy_names[] = {
+    [POLICY_LRU] = "lru",     [POLICY_FIFO] = "fifo",
+    [POLICY_RANDOM] = "random", [POLICY_PLRU] = "plru",
+    [POLICY_SRRIP] = "srrip", [POLICY_BRRIP] = "brrip",
+    [POLICY_LFU] = "lfu",
+};
 
-  new_block->l = 0;
-  new_block->r = 0;
+// behaviour shared by every cache of a run, set from the command line
+typedef struct cache_options {
+  replacement_policy_t policy;
+  unsigned long long seed; // random and BRRIP
+  bool write_allocate;     // store misses load the block
+  bool write_through;      // stores go straight to the next level
+  bool split_unaligned;    // simulate every block an access touches
+  size_t victim_entries;   // fully associative victim cache, 0 for none
+} cache_options_t;
 
-  return new_block;
-}
+#define RRPV_MAX 3
+#define BRRIP_LONG_INTERVAL 32 // 1 in 32 BRRIP fills is inserted at RRPV 2
 
-void break_down_block(block_t *block) { free(block); }
+struct access_result; // see execute_operation_in_cache
 
-// block section end
+typedef struct cache {
+  int s; // setIndexBits
+  int b; // blockBits
+  size_t line_count; // Associativity (E)
+  size_t set_count;
 
-// Line section begin
-typedef struct Line {
-  int valid;
-  size_t tag;
+  size_t set_mask;
+  int tag_shift; // s + b
 
-  unsigned long long last_access_time;
-  block_t *block;
-} line_t;
+  replacement_policy_t policy;
+  bool write_allocate;
+  bool write_through;
+  unsigned long long time; // LRU clock
+  unsigned long long seed; // random and BRRIP
 
-line_t construct_line() {
-  line_t line = {.valid = 0, .tag = 0};
-  line.block = construct_block();
+  size_t *tags;                   // [set_count * line_count], see
+                                  // line_tag, INVALID_LINE when free
+  unsigned char *dirty;           // [set_count * line_count]
+  unsigned char *prefetched;      // [set_count * line_count], filled by a
+                                  // prefetch and not demanded since
+  unsigned long long *line_state; // [set_count * line_count], per policy:
+                                  // LRU or FIFO fill stamp, RRPV or LFU
+                                  // use count
+  unsigned long long *set_state;  // [set_count], PLRU tree or random state
 
-  return line;
-}
+  struct cache *victims; // LRU victim cache behind the sets, or NULL
 
-int is_address_in_line(struct Line *line, size_t tag, operation_t operation) {
-  int isInLine = 0;
+  // execute_operation_in_cache, or a kernel specialised for this geometry
+  void (*kernel)(struct cache *cache, operation_t operation, size_t address,
+                 size_t size, struct access_result *result);
+} cache_t;
 
-  if (line->valid && line->tag == tag)
-    isInLine = 1;
-  if (isInLine /*&& operation == DATA_STORE*/)
-    line->last_access_time = ++global_time;
+// number of blocks of 2^b bytes touched by size bytes at address
+static inline size_t blocks_touched(size_t address, size_t size, int b) {
+  if (size == 0)
+    return 1;
+  return ((address + size - 1) >> b) - (address >> b) + 1;
+}
 
-  return isInLine;
+static inline size_t set_index_of(const cache_t *cache, size_t address) {
+  return cache->set_mask & (address >> cache->b);
 }
 
-void load_new_block_in_line(line_t *line, size_t tag, size_t address,
-                            size_t block_bits) {
-  line->tag = tag;
-  line->valid = 1;
-  flush_and_fetch_new_block(line->block, address, block_bits);
+// index of the first line of set_index in the flat line arrays
+static inline size_t set_base(const cache_t *cache, size_t set_index) {
+  return set_index * cache->line_count;
 }
 
-void break_down_line(line_t *line) {
-  break_down_block(line->block);
+#define INVALID_LINE ((size_t)0)
 
-  free(line);
+// what a valid line holding tag stores, never INVALID_LINE
+static inline size_t line_tag(size_t tag) {
+  return tag + 1;
 }
 
-// Line section end
+static inline size_t tag_of_line(const cache_t *cache, size_t index) {
+  return cache->tags[index] - 1;
+}
 
-// Set section start
-typedef struct set {
-  size_t line_count; // Associativity (E)
-  line_t *lines;
-} set_t;
+// full address of the block holding tag in set_index
+static inline size_t block_address(const cache_t *cache, size_t set_index,
+                                   size_t tag) {
+  return (tag << cache->tag_shift) | (set_index << cache->b);
+}
 
-set_t construct_set(size_t line_count) {
-  set_t set;
+// first way in [0, ways) storing key, or ways; when key is absent
+// *free_way is the first INVALID_LINE way, or ways if there is none
+static inline size_t find_way(const size_t *lines, size_t ways, size_t key,
+                              size_t *free_way) {
+  size_t i = 0;
+  *free_way = ways;
 
-  set.line_count = line_count;
-  set.lines = malloc(sizeof(line_t) * line_count);
+#if defined(__AVX2__)
+  __m256i needle = _mm256_set1_epi64x(key);
+  __m256i empty = _mm256_setzero_si256();
+  for (; i + 4 <= ways; i += 4) {
+    __m256i chunk = _mm256_loadu_si256((const __m256i *)(lines + i));
+    unsigned hits = _mm256_movemask_pd(
+        _mm256_castsi256_pd(_mm256_cmpeq_epi64(chunk, needle)));
+    unsigned frees = _mm256_movemask_pd(
+        _mm256_castsi256_pd(_mm256_cmpeq_epi64(chunk, empty)));
+    if (frees && *free_way == ways)
+      *free_way = i + __builtin_ctz(frees);
+    if (hits)
+      return i + __builtin_ctz(hits);
+  }
+#elif defined(__SSE2__)
+  // SSE2 only compares 32 bit lanes: a 64 bit lane matches when both of
+  // its halves do
+  __m128i needle = _mm_set1_epi64x(key);
+  __m128i empty = _mm_setzero_si128();
+  for (; i + 2 <= ways; i += 2) {
+    __m128i chunk = _mm_loadu_si128((const __m128i *)(lines + i));
+    __m128i hit32 = _mm_cmpeq_epi32(chunk, needle);
+    __m128i free32 = _mm_cmpeq_epi32(chunk, empty);
+    __m128i hit64 = _mm_and_si128(
+        hit32, _mm_shuffle_epi32(hit32, _MM_SHUFFLE(2, 3, 0, 1)));
+    __m128i free64 = _mm_and_si128(
+        free32, _mm_shuffle_epi32(free32, _MM_SHUFFLE(2, 3, 0, 1)));
+    unsigned hits = _mm_movemask_pd(_mm_castsi128_pd(hit64));
+    unsigned frees = _mm_movemask_pd(_mm_castsi128_pd(free64));
+    if (frees && *free_way == ways)
+      *free_way = i + __builtin_ctz(frees);
+    if (hits)
+      return i + __builtin_ctz(hits);
+  }
+#endif
 
-  if (!set.lines) {
-    perror("line malloc failure");
-    exit(EXIT_FAILURE);
+  for (; i < ways; i++) {
+    if (lines[i] == INVALID_LINE && *free_way == ways)
+      *free_way = i;
+    if (lines[i] == key)
+      return i;
   }
+  return ways;
+}
 
-  for (size_t i = 0; i < line_count; i++) {
-    set.lines[i] = construct_line();
+// on a hit *line is the way holding tag, on a miss the first free way, or
+// line_count when the set is full
+set_probe_result_t probe_set_for_memory(cache_t *cache, size_t set_index,
+                                        size_t tag, size_t *line) {
+  const size_t *lines = cache->tags + set_base(cache, set_index);
+  size_t free_way;
+  size_t way = find_way(lines, cache->line_count, line_tag(tag), &free_way);
+
+  if (way < cache->line_count) {
+    *line = way;
+    return PROBE_HIT;
   }
 
-  return set;
+  // a miss scanned the whole set, so free_way is the first free way
+  *line = free_way;
+  return PROBE_MISS;
 }
 
-void break_down_set(set_t *set) {
-  for (size_t i = 0; i < set->line_count; i++) {
-    break_down_line(&set->lines[i]);
+// Replacement section start
+
+// each set draws from its own xorshift stream, so a run gives the same
+// victims whichever thread owns the set
+static inline unsigned long long next_random(cache_t *cache,
+                                             size_t set_index) {
+  unsigned long long *rng = &cache->set_state[set_index];
+
+  if (*rng == 0) {
+    // splitmix64 of (seed, set) so neighbouring sets are uncorrelated
+    unsigned long long z =
+        cache->seed + (set_index + 1) * 0x9e3779b97f4a7c15ULL;
+    z = (z ^ (z >> 30)) * 0xbf58476d1ce4e5b9ULL;
+    z = (z ^ (z >> 27)) * 0x94d049bb133111ebULL;
+    *rng = (z ^ (z >> 31)) | 1;
   }
 
-  // free(set->lines);
-  free(set);
+  *rng ^= *rng << 13;
+  *rng ^= *rng >> 7;
+  *rng ^= *rng << 17;
+  return *rng;
 }
 
-set_probe_result_t probe_set_for_memory(set_t *set, size_t tag,
-                                        size_t *hit_line,
-                                        operation_t operation) {
-  set_probe_result_t probeResult = PROBE_MISS;
+static inline int log2_ways(const cache_t *cache) {
+  int levels = 0;
+  while ((1UL << levels) < cache->line_count)
+    levels++;
+  return levels;
+}
 
-  size_t line_count = set->line_count;
+// point every PLRU tree node on the path to line away from it
+static void plru_touch(cache_t *cache, size_t set_index, size_t line) {
+  unsigned long long *tree = &cache->set_state[set_index];
+  size_t node = 1;
 
-  for (size_t i = 0; i < line_count; i++) {
-    struct Line *line = &set->lines[i];
-    if (is_address_in_line(line, tag, operation)) {
-      probeResult = PROBE_HIT;
-      *hit_line = i;
-    }
+  for (int level = log2_ways(cache) - 1; level >= 0; level--) {
+    size_t direction = (line >> level) & 1;
+    if (direction)
+      *tree &= ~(1ULL << node);
+    else
+      *tree |= 1ULL << node;
+    node = 2 * node + direction;
   }
+}
 
-  return probeResult;
-};
+static size_t plru_victim(const cache_t *cache, size_t set_index) {
+  unsigned long long tree = cache->set_state[set_index];
+  size_t node = 1;
+  size_t line = 0;
+
+  for (int level = log2_ways(cache); level > 0; level--) {
+    size_t direction = (tree >> node) & 1;
+    line = (line << 1) | direction;
+    node = 2 * node + direction;
+  }
+  return line;
+}
+
+static size_t rrip_victim(cache_t *cache, size_t set_index) {
+  unsigned long long *rrpv = cache->line_state + set_base(cache, set_index);
+  unsigned long long oldest = 0;
 
-void getblockFromSet(set_t *set) {} // NOTE: not required
-
-size_t line_to_evict(set_t *set) {
-  // evict based on a cache eviction policy
-  // printf("evicting %ld\n", set->line_count);
-  size_t target_line = -1;
-  unsigned long long min_time = INT_MAX;
-  for (size_t i = 0; i < set->line_count; i++) {
-    line_t line = set->lines[i];
-    if (line.last_access_time <= min_time) {
-      min_time = line.last_access_time;
+  for (size_t i = 0; i < cache->line_count; i++)
+    if (rrpv[i] > oldest)
+      oldest = rrpv[i];
+
+  // age the whole set until some line is predicted distant
+  size_t target_line = 0;
+  for (size_t i = cache->line_count; i-- > 0;) {
+    rrpv[i] += RRPV_MAX - oldest;
+    if (rrpv[i] == RRPV_MAX)
       target_line = i;
-    }
   }
   return target_line;
 }
 
-int should_set_evict(set_t *set, size_t *line_to_load_into) {
-  int should_evict = 1;
+// index of the smallest state word in the set, lowest way on ties; the
+// LRU, FIFO and LFU victim, found by scanning all E ways
+static size_t min_state_line(const cache_t *cache, size_t set_index) {
+  const unsigned long long *state =
+      cache->line_state + set_base(cache, set_index);
 
-  for (size_t i = 0; i < set->line_count; i++) {
-    should_evict = should_evict & set->lines[i].valid;
-    if (!set->lines[i].valid)
-      *line_to_load_into = i;
+  size_t target_line = 0;
+  for (size_t i = 1; i < cache->line_count; i++) {
+    if (state[i] < state[target_line])
+      target_line = i;
   }
+  return target_line;
+}
 
-  return should_evict;
+size_t line_to_evict(cache_t *cache, size_t set_index) {
+  switch (cache->policy) {
+  case POLICY_RANDOM:
+    return next_random(cache, set_index) % cache->line_count;
+  case POLICY_PLRU:
+    return plru_victim(cache, set_index);
+  case POLICY_SRRIP:
+  case POLICY_BRRIP:
+    return rrip_victim(cache, set_index);
+  case POLICY_LRU:
+  case POLICY_FIFO:
+  case POLICY_LFU:
+    break;
+  }
+  return min_state_line(cache, set_index);
 }
 
-void handle_operation(set_t *set, size_t tag, size_t offset, size_t address,
-                      size_t block_bits, enum set_probe_result *probe_result,
-                      operation_t operation, int *did_evict) {
-  size_t hit_line = 0;
-  *probe_result = probe_set_for_memory(set, tag, &hit_line, operation);
+// update the replacement state after line was hit or filled
+void touch_line(cache_t *cache, size_t set_index, size_t line, bool is_fill) {
+  unsigned long long *state = &cache->line_state[set_base(cache, set_index) +
+                                                 line];
 
-  if (*probe_result == PROBE_MISS) {
-    size_t line_to_load_into = -1;
-    *did_evict = should_set_evict(set, &line_to_load_into);
-    if (*did_evict)
-      line_to_load_into = line_to_evict(set);
-    assert(line_to_load_into != -1);
-    load_new_block_in_line(&set->lines[line_to_load_into], tag, address,
-                           block_bits);
-    set->lines[line_to_load_into].last_access_time = ++global_time;
+  switch (cache->policy) {
+  case POLICY_LRU:
+    *state = ++cache->time;
+    break;
+  case POLICY_FIFO:
+    // stamped on fill only, so the victim is the oldest fill; a per-set
+    // hand would be O(1) but goes wrong once invalidations free ways out
+    // of fill order
+    if (is_fill)
+      *state = ++cache->time;
+    break;
+  case POLICY_RANDOM:
+    break;
+  case POLICY_PLRU:
+    plru_touch(cache, set_index, line);
+    break;
+  case POLICY_SRRIP:
+    *state = is_fill ? RRPV_MAX - 1 : 0;
+    break;
+  case POLICY_BRRIP:
+    if (!is_fill)
+      *state = 0;
+    else if (next_random(cache, set_index) % BRRIP_LONG_INTERVAL == 0)
+      *state = RRPV_MAX - 1;
+    else
+      *state = RRPV_MAX;
+    break;
+  case POLICY_LFU:
+    *state = is_fill ? 1 : *state + 1;
+    break;
   }
 }
 
-// Set section end
+// Replacement section end
 
-// Cache section start
+int should_set_evict(cache_t *cache, size_t set_index,
+                     size_t *line_to_load_into) {
+  const size_t *lines = cache->tags + set_base(cache, set_index);
+  size_t free_way;
 
-typedef struct cache {
-  int s; // setIndexBits
-  int b; // blockBits
-  set_t *sets;
-} cache_t;
+  *line_to_load_into =
+      find_way(lines, cache->line_count, INVALID_LINE, &free_way);
+  return *line_to_load_into == cache->line_count;
+}
+
+// probe for tag, on a miss load it unless allocate is false;
+// unused_prefetch reports a hit on, or an eviction of, a prefetched line
+// that had not been demanded yet
+void handle_operation(cache_t *cache, size_t set_index, size_t tag,
+                      bool allocate, bool make_dirty,
+                      set_probe_result_t *probe_result, int *did_evict,
+                      size_t *victim, bool *victim_dirty,
+                      bool *unused_prefetch) {
+  size_t line = 0;
+  *probe_result = probe_set_for_memory(cache, set_index, tag, &line);
+  size_t index = set_base(cache, set_index) + line;
+
+  if (*probe_result == PROBE_MISS) {
+    if (!allocate)
+      return;
+
+    // the probe already found the first free way
+    *did_evict = line == cache->line_count;
+    if (*did_evict)
+      line = line_to_evict(cache, set_index);
+
+    index = set_base(cache, set_index) + line;
+    if (*did_evict)
+      *victim = block_address(cache, set_index, tag_of_line(cache, index));
+    *victim_dirty = *did_evict && cache->dirty[index];
+    *unused_prefetch = *did_evict && cache->prefetched[index];
+    cache->tags[index] = line_tag(tag);
+    cache->dirty[index] = 0;
+  } else {
+    *unused_prefetch = cache->prefetched[index];
+  }
+  cache->prefetched[index] = 0;
+
+  if (make_dirty)
+    cache->dirty[index] = 1;
+  touch_line(cache, set_index, line, *probe_result == PROBE_MISS);
+}
 
-void execute_operation_in_cache(
-    cache_t *cache, operation_t operation, size_t address,
-    size_t size,        // NOTE: ignore the size and assume the
-    unsigned int *miss, // accesses are aligned perfectly
-    unsigned int *hit, unsigned int *eviction) {
-  size_t set_mask = (1UL << cache->s) - 1; // TODO: get set mask
-  size_t block_mask = (1UL << cache->b) - 1;
+// what one trace access did to the cache and to the level below it
+typedef struct access_result {
+  unsigned int miss;
+  unsigned int hit;
+  unsigned int eviction;
+  unsigned int dirty_eviction;
+  size_t bytes_read;    // fetched from the next level
+  size_t bytes_written; // written to the next level
+  unsigned int prefetch_hit;     // first demand hit on a prefetched line
+  unsigned int prefetch_evicted; // prefetched lines evicted unused
+  unsigned int victim_hit;       // misses served by the victim cache
+} access_result_t;
 
-  size_t offset = block_mask & address;
-  size_t setIndex = set_mask & (address >> cache->b);
+static bool exchange_with_victims(cache_t *cache, size_t address,
+                                  bool did_evict, size_t victim,
+                                  bool *victim_dirty);
 
-  size_t tag = address >> (cache->s + cache->b);
+// access the block holding address, size bytes of which are touched; the
+// counts are added to result so one trace access may span several calls
+void execute_operation_in_cache(cache_t *cache, operation_t operation,
+                                size_t address, size_t size,
+                                access_result_t *result) {
+  size_t set_index = set_index_of(cache, address);
+  size_t tag = address >> cache->tag_shift;
+  size_t block_size = 1UL << cache->b;
 
-  printf("set: %lx tag: %lx offset: %lx  ", setIndex, tag, offset);
+  bool is_write = operation != DATA_LOAD;
+  bool allocate = operation != DATA_STORE || cache->write_allocate;
+  bool make_dirty = is_write && !cache->write_through;
 
   set_probe_result_t probe_result = PROBE_MISS;
   int did_evict = 0;
-  handle_operation(&cache->sets[setIndex], tag, offset, cache->b, address,
-                   &probe_result, operation, &did_evict);
+  size_t victim = 0;
+  bool victim_dirty = false;
+  bool unused_prefetch = false;
+  handle_operation(cache, set_index, tag, allocate, make_dirty, &probe_result,
+                   &did_evict, &victim, &victim_dirty, &unused_prefetch);
+
+  bool victim_hit = false;
+  if (cache->victims && probe_result == PROBE_MISS && allocate) {
+    victim_hit = exchange_with_victims(cache, address, did_evict, victim,
+                                       &victim_dirty);
+    result->victim_hit += victim_hit;
+  }
+
   if (did_evict)
-    *eviction = 1;
+    result->eviction += 1;
+  if (unused_prefetch) {
+    if (probe_result == PROBE_HIT)
+      result->prefetch_hit += 1;
+    else
+      result->prefetch_evicted += 1;
+  }
+  if (victim_dirty) {
+    result->dirty_eviction += 1;
+    result->bytes_written += block_size;
+  }
   switch (probe_result) {
   case PROBE_MISS:
-    *miss = 1;
+    result->miss += 1;
+    if (allocate && !victim_hit)
+      result->bytes_read += block_size;
     break;
   case PROBE_HIT:
-    *hit = 1;
+    result->hit += 1;
     break;
   }
 
+  // the data of a write that left no dirty line behind goes down now
+  if (is_write && (cache->write_through || !allocate))
+    result->bytes_written += size;
+
   if (operation == MODIFY) {
-    *hit += 1;
+    result->hit += 1;
+  }
+}
+
+// Kernel section start
+
+/*
+The common geometries get their own copy of the access path, generated by
+including csim-kernel.h once per (E, b) pair with both as literals. Only
+LRU, write-back, write-allocate caches without a victim cache qualify;
+anything else, and any other E or b, takes execute_operation_in_cache.
+The number of sets stays a runtime mask: it changes no control flow.
+*/
+
+#define KERNEL_BLOCK_BITS 5
+#define KERNEL_WAYS 1
+#include "csim-kernel.h"
+#undef KERNEL_WAYS
+#define KERNEL_WAYS 2
+#include "csim-kernel.h"
+#undef KERNEL_WAYS
+#define KERNEL_WAYS 4
+#include "csim-kernel.h"
+#undef KERNEL_WAYS
+#define KERNEL_WAYS 8
+#include "csim-kernel.h"
+#undef KERNEL_WAYS
+#define KERNEL_WAYS 16
+#include "csim-kernel.h"
+#undef KERNEL_WAYS
+#undef KERNEL_BLOCK_BITS
+
+#define KERNEL_BLOCK_BITS 6
+#define KERNEL_WAYS 1
+#include "csim-kernel.h"
+#undef KERNEL_WAYS
+#define KERNEL_WAYS 2
+#include "csim-kernel.h"
+#undef KERNEL_WAYS
+#define KERNEL_WAYS 4
+#include "csim-kernel.h"
+#undef KERNEL_WAYS
+#define KERNEL_WAYS 8
+#include "csim-kernel.h"
+#undef KERNEL_WAYS
+#define KERNEL_WAYS 16
+#include "csim-kernel.h"
+#undef KERNEL_WAYS
+#undef KERNEL_BLOCK_BITS
+
+#define KERNEL_MIN_BLOCK_BITS 5
+#define KERNEL_MAX_BLOCK_BITS 6
+#define KERNEL_MAX_LOG_WAYS 4
+
+// [b - KERNEL_MIN_BLOCK_BITS][log2 E]
+static void (*const lru_kernels[][KERNEL_MAX_LOG_WAYS + 1])(
+    cache_t *, operation_t, size_t, size_t, access_result_t *) = {
+    {lru_kernel_1_5, lru_kernel_2_5, lru_kernel_4_5, lru_kernel_8_5,
+     lru_kernel_16_5},
+    {lru_kernel_1_6, lru_kernel_2_6, lru_kernel_4_6, lru_kernel_8_6,
+     lru_kernel_16_6},
+};
+
+void select_kernel(cache_t *cache) {
+  size_t e = cache->line_count;
+
+  cache->kernel = execute_operation_in_cache;
+  if (cache->policy != POLICY_LRU || !cache->write_allocate ||
+      cache->write_through || cache->victims ||
+      cache->b < KERNEL_MIN_BLOCK_BITS || cache->b > KERNEL_MAX_BLOCK_BITS ||
+      (e & (e - 1)) != 0 || e > (1UL << KERNEL_MAX_LOG_WAYS))
+    return;
+
+  cache->kernel =
+      lru_kernels[cache->b - KERNEL_MIN_BLOCK_BITS][__builtin_ctzl(e)];
+}
+
+// Kernel section end
+
+// Block section start
+
+/*
+Whole-block operations for callers that move blocks between caches (the
+hierarchy) rather than just counting hits: each takes a full address and
+keeps the replacement state and dirty bits up to date.
+*/
+
+// probe for address, on a hit touch the line and optionally dirty it
+bool lookup_block(cache_t *cache, size_t address, bool make_dirty) {
+  size_t set_index = set_index_of(cache, address);
+  size_t line;
+
+  if (probe_set_for_memory(cache, set_index, address >> cache->tag_shift,
+                           &line) == PROBE_MISS)
+    return false;
+
+  touch_line(cache, set_index, line, false);
+  if (make_dirty)
+    cache->dirty[set_base(cache, set_index) + line] = 1;
+  return true;
+}
+
+// load address into its set, returns whether a valid victim was displaced
+bool fill_block(cache_t *cache, size_t address, bool dirty, size_t *victim,
+                bool *victim_dirty) {
+  size_t set_index = set_index_of(cache, address);
+  size_t line = 0;
+
+  bool did_evict = should_set_evict(cache, set_index, &line);
+  if (did_evict)
+    line = line_to_evict(cache, set_index);
+
+  size_t index = set_base(cache, set_index) + line;
+  if (did_evict) {
+    *victim = block_address(cache, set_index, tag_of_line(cache, index));
+    *victim_dirty = cache->dirty[index];
+  }
+
+  cache->tags[index] = line_tag(address >> cache->tag_shift);
+  cache->dirty[index] = dirty;
+  cache->prefetched[index] = 0;
+  touch_line(cache, set_index, line, true);
+  return did_evict;
+}
+
+// load address as a prefetch unless present, returns whether it was loaded
+bool prefetch_block(cache_t *cache, size_t address, bool *did_evict,
+                    size_t *victim, bool *victim_dirty, bool *victim_unused) {
+  size_t set_index = set_index_of(cache, address);
+  size_t line;
+
+  *did_evict = false;
+  if (probe_set_for_memory(cache, set_index, address >> cache->tag_shift,
+                           &line) == PROBE_HIT)
+    return false;
+
+  *did_evict = should_set_evict(cache, set_index, &line);
+  if (*did_evict)
+    line = line_to_evict(cache, set_index);
+
+  size_t index = set_base(cache, set_index) + line;
+  if (*did_evict) {
+    *victim = block_address(cache, set_index, tag_of_line(cache, index));
+    *victim_dirty = cache->dirty[index];
+    *victim_unused = cache->prefetched[index];
+  }
+
+  cache->tags[index] = line_tag(address >> cache->tag_shift);
+  cache->dirty[index] = 0;
+  cache->prefetched[index] = 1;
+  touch_line(cache, set_index, line, true);
+  return true;
+}
+
+// drop address if present, returns whether it was
+bool invalidate_block(cache_t *cache, size_t address, bool *was_dirty) {
+  size_t set_index = set_index_of(cache, address);
+  size_t line;
+
+  if (probe_set_for_memory(cache, set_index, address >> cache->tag_shift,
+                           &line) == PROBE_MISS)
+    return false;
+
+  size_t index = set_base(cache, set_index) + line;
+  *was_dirty = cache->dirty[index];
+  cache->tags[index] = INVALID_LINE;
+  cache->dirty[index] = 0;
+  cache->prefetched[index] = 0;
+  return true;
+}
+
+// the victim cache gives back address if it holds it and takes the line
+// the set evicted in exchange; *victim_dirty then tells whether the line
+// the victim cache let go of needs writing back. Returns whether address
+// was found
+static bool exchange_with_victims(cache_t *cache, size_t address,
+                                  bool did_evict, size_t victim,
+                                  bool *victim_dirty) {
+  cache_t *victims = cache->victims;
+  bool was_dirty = false;
+  bool found = invalidate_block(victims, address, &was_dirty);
+
+  if (found && was_dirty) {
+    size_t set_index = set_index_of(cache, address);
+    size_t line;
+    probe_set_for_memory(cache, set_index, address >> cache->tag_shift,
+                         &line);
+    cache->dirty[set_base(cache, set_index) + line] = 1;
+  }
+
+  if (did_evict) {
+    size_t spilled;
+    bool spilled_dirty = false;
+    bool spilled_any =
+        fill_block(victims, victim, *victim_dirty, &spilled, &spilled_dirty);
+    *victim_dirty = spilled_any && spilled_dirty;
+  }
+  return found;
+}
+
+// Block section end
+
+/*
+Inside libcsim an allocation failure must not exit the host program.
+While the library builds a simulator, checked_calloc logs every block to
+an allocation_unwind_t; a failure frees the logged blocks and longjmps
+back to the builder, which reports the error instead. The command line
+never arms it.
+*/
+
+#define UNWIND_MAX_ALLOCATIONS 32 // a simulator with a victim cache uses 13
+
+typedef struct allocation_unwind {
+  jmp_buf target;
+  void *allocations[UNWIND_MAX_ALLOCATIONS];
+  size_t count;
+} allocation_unwind_t;
+
+static __thread allocation_unwind_t *allocation_unwind;
+
+void *checked_calloc(size_t count, size_t size) {
+  void *memory = calloc(count, size);
+
+  allocation_unwind_t *unwind = allocation_unwind;
+  if (unwind) {
+    if (memory && unwind->count < UNWIND_MAX_ALLOCATIONS) {
+      unwind->allocations[unwind->count++] = memory;
+      return memory;
+    }
+    free(memory);
+    for (size_t i = 0; i < unwind->count; i++)
+      free(unwind->allocations[i]);
+    longjmp(unwind->target, 1);
+  }
+
+  if (!memory) {
+    perror("cache calloc failure");
+    exit(EXIT_FAILURE);
   }
+
+  return memory;
+}
+
+// why 2^s sets of e lines of 2^b bytes cannot be simulated under policy,
+// NULL if they can; the command line and csim_create both check this first
+const char *config_error(size_t s, size_t b, size_t e,
+                         replacement_policy_t policy) {
+  if (e == 0)
+    return "E must be at least 1";
+  if (s >= 64 || b >= 64 || s + b >= 64)
+    return "s + b must be below 64";
+  if (e > SIZE_MAX >> s)
+    return "2^s * E lines do not fit in the address space";
+  if (policy == POLICY_PLRU && ((e & (e - 1)) != 0 || e > 64))
+    return "plru needs E to be a power of two <= 64";
+  return NULL;
 }
 
-cache_t *construct_cache(size_t s, size_t b, size_t e) {
-  cache_t *cache = malloc(sizeof(cache_t));
+cache_t *construct_cache(size_t s, size_t b, size_t e,
+                         const cache_options_t *options) {
+  cache_t *cache = checked_calloc(1, sizeof(cache_t));
 
-  size_t set_count = 1 << s;
-  cache->sets = malloc(sizeof(set_t) * set_count);
   cache->s = s;
   cache->b = b;
+  cache->line_count = e;
+  cache->set_count = 1UL << s;
+  cache->set_mask = cache->set_count - 1;
+  cache->tag_shift = s + b;
+  cache->policy = options->policy;
+  cache->write_allocate = options->write_allocate;
+  cache->write_through = options->write_through;
+  cache->time = 0;
+  cache->seed = options->seed;
+
+  size_t total_lines = cache->set_count * e;
+  cache->tags = checked_calloc(total_lines, sizeof(size_t));
+  cache->dirty = checked_calloc(total_lines, sizeof(unsigned char));
+  cache->prefetched = checked_calloc(total_lines, sizeof(unsigned char));
+  cache->line_state = checked_calloc(total_lines, sizeof(unsigned long long));
+  cache->set_state =
+      checked_calloc(cache->set_count, sizeof(unsigned long long));
 
-  for (size_t i = 0; i < set_count; i++) {
-    cache->sets[i] = construct_set(e);
+  if (options->victim_entries > 0) {
+    cache_options_t victim_options = *options;
+    victim_options.policy = POLICY_LRU;
+    victim_options.victim_entries = 0;
+    cache->victims =
+        construct_cache(0, b, options->victim_entries, &victim_options);
   }
 
+  select_kernel(cache);
   return cache;
 }
 
 void break_down_cache(cache_t *cache) {
-  for (size_t i = 0; i < 1 << cache->s; i++) {
-    break_down_set(&cache->sets[i]);
-  }
-
-  // free(cache->sets);
+  free(cache->tags);
+  free(cache->dirty);
+  free(cache->prefetched);
+  free(cache->line_state);
+  free(cache->set_state);
+  if (cache->victims)
+    break_down_cache(cache->victims);
   free(cache);
 }
 
 // Cache section end
 
-// Csim start
+// Block map section start
 
-typedef struct cache_simulator {
-  // int e;          // associativity
-  bool is_verbose; // 0 -> concise
+/*
+An open-addressing hash map from block numbers to one size_t each, used
+wherever a simulator needs to find a block without scanning (stack distance
+stamps, shadow caches, seen-block sets). Linear probing with backward-shift
+deletion keeps it tombstone free; it doubles once three quarters full.
+*/
 
-  unsigned int hits;
-  unsigned int misses;
-  unsigned int evictions;
+typedef struct block_map {
+  size_t *keys;   // block + 1, 0 marks an empty slot
+  size_t *values;
+  size_t mask;    // capacity - 1, capacity is a power of two
+  size_t count;
+} block_map_t;
 
-  cache_t *cache;
-} cache_simulator_t;
+void init_block_map(block_map_t *map, size_t min_capacity) {
+  size_t capacity = 16;
+  while (capacity < min_capacity)
+    capacity *= 2;
+
+  map->keys = checked_calloc(capacity, sizeof(size_t));
+  map->values = checked_calloc(capacity, sizeof(size_t));
+  map->mask = capacity - 1;
+  map->count = 0;
+}
 
-void get_address_and_mem_size(char *instruction, size_t *address,
-                              size_t *size) {
-  instruction += 2;
-  char *token = strtok(instruction, ",");
+void free_block_map(block_map_t *map) {
+  free(map->keys);
+  free(map->values);
+}
 
-  *address = strtoul(token, NULL, 16);
+static inline size_t block_map_home(const block_map_t *map, size_t block) {
+  return (block * 0x9e3779b97f4a7c15ULL >> 17) & map->mask;
+}
 
-  token = strtok(NULL, ",");
-  *size = strtoul(token, NULL, 16);
-};
+// slot holding block, or the empty slot where it would go
+static inline size_t block_map_find(const block_map_t *map, size_t block) {
+  size_t slot = block_map_home(map, block);
+  while (map->keys[slot] && map->keys[slot] != block + 1)
+    slot = (slot + 1) & map->mask;
+  return slot;
+}
+
+static inline bool block_map_used(const block_map_t *map, size_t slot) {
+  return map->keys[slot] != 0;
+}
+
+void block_map_put(block_map_t *map, size_t block, size_t value);
+
+static void grow_block_map(block_map_t *map) {
+  block_map_t old = *map;
+  init_block_map(map, 2 * (old.mask + 1));
 
-void simulate_trace(cache_simulator_t *cache_simulator, char *instruction) {
-  if (instruction[0] == ' ') {
-    instruction += 0x1;
+  for (size_t slot = 0; slot <= old.mask; slot++)
+    if (old.keys[slot])
+      block_map_put(map, old.keys[slot] - 1, old.values[slot]);
+
+  free_block_map(&old);
+}
+
+// insert block or overwrite its value
+void block_map_put(block_map_t *map, size_t block, size_t value) {
+  size_t slot = block_map_find(map, block);
+
+  if (!map->keys[slot]) {
+    if (4 * (map->count + 1) > 3 * (map->mask + 1)) {
+      grow_block_map(map);
+      slot = block_map_find(map, block);
+    }
+    map->keys[slot] = block + 1;
+    map->count++;
   }
-  char op_char = instruction[0];
-  operation_t operation = INSTRUCTION_LOAD;
+  map->values[slot] = value;
+}
 
-  switch (op_char) {
-  case 'I':
-    operation = INSTRUCTION_LOAD;
-    return;
-  case 'L':
-    operation = DATA_LOAD;
-    break;
-  case 'M':
-    operation = MODIFY;
-    break;
-  case 'S':
-    operation = DATA_STORE;
-    break;
+// delete the used slot, shifting later entries of its cluster back
+void block_map_remove(block_map_t *map, size_t slot) {
+  size_t hole = slot;
+  for (size_t next = (slot + 1) & map->mask; map->keys[next];
+       next = (next + 1) & map->mask) {
+    size_t home = block_map_home(map, map->keys[next] - 1);
+    // move next into the hole unless its home lies cyclically in (hole, next]
+    if (((next - home) & map->mask) >= ((next - hole) & map->mask)) {
+      map->keys[hole] = map->keys[next];
+      map->values[hole] = map->values[next];
+      hole = next;
+    }
   }
-  // ignore INSTRUCTION_LOAD operation (do a no_op in the method)
-  size_t address, size;
+  map->keys[hole] = 0;
+  map->count--;
+}
+
+// drop every entry, keeping the capacity
+void clear_block_map(block_map_t *map) {
+  memset(map->keys, 0, sizeof(size_t) * (map->mask + 1));
+  map->count = 0;
+}
+
+// Block map section end
+
+// Classification section start
 
-  get_address_and_mem_size(instruction, &address, &size);
+/*
+The 3C model splits misses into compulsory (the block was never touched
+before), capacity (a fully associative LRU cache with as many lines would
+have missed too) and conflict (only the set mapping made it miss). A shadow
+fully associative LRU cache, kept as a block map plus a doubly linked
+recency list over a fixed node pool, runs beside the real cache in O(1) per
+access; a second block map remembers every block ever touched.
+*/
+
+#define NO_NODE ((size_t)-1)
+
+typedef struct miss_classifier {
+  size_t line_count; // lines in the shadow cache, S * E
+  size_t used;       // nodes handed out so far
 
-  unsigned int miss, hit, eviction = 0;
-    execute_operation_in_cache(cache_simulator->cache, operation, address, size,
-                               &miss, &hit, &eviction);
+  size_t *node_block; // [line_count]
+  size_t *prev;       // [line_count], towards the most recent node
+  size_t *next;       // [line_count], towards the least recent node
+  size_t head;        // most recently used node
+  size_t tail;        // least recently used node
 
-  if (cache_simulator->is_verbose)
-    printf("Verbose: %s %d %d %d\n", instruction, miss, hit, eviction);
+  block_map_t shadow; // block -> node
+  block_map_t seen;   // every block touched so far
 
-  cache_simulator->misses += miss;
-  cache_simulator->hits += hit;
-  cache_simulator->evictions += eviction;
+  unsigned long long compulsory;
+  unsigned long long capacity;
+  unsigned long long conflict;
+} miss_classifier_t;
+
+miss_classifier_t *construct_miss_classifier(size_t line_count) {
+  miss_classifier_t *classifier =
+      checked_calloc(1, sizeof(miss_classifier_t));
+
+  classifier->line_count = line_count;
+  classifier->node_block = checked_calloc(line_count, sizeof(size_t));
+  classifier->prev = checked_calloc(line_count, sizeof(size_t));
+  classifier->next = checked_calloc(line_count, sizeof(size_t));
+  classifier->head = NO_NODE;
+  classifier->tail = NO_NODE;
+
+  init_block_map(&classifier->shadow, 2 * line_count);
+  init_block_map(&classifier->seen, 1024);
+  return classifier;
 }
 
-cache_simulator_t *construct_cache_simulator(size_t s, size_t b, size_t e,
-                                             bool is_verbose) {
-  cache_simulator_t *cache_simulator = malloc(sizeof(cache_simulator_t));
+void break_down_miss_classifier(miss_classifier_t *classifier) {
+  free(classifier->node_block);
+  free(classifier->prev);
+  free(classifier->next);
+  free_block_map(&classifier->shadow);
+  free_block_map(&classifier->seen);
+  free(classifier);
+}
 
-  cache_simulator->misses = 0;
-  cache_simulator->hits = 0;
-  cache_simulator->evictions = 0;
-  cache_simulator->is_verbose = is_verbose;
-  cache_simulator->cache = construct_cache(s, b, e);
+static void unlink_node(miss_classifier_t *classifier, size_t node) {
+  size_t prev = classifier->prev[node];
+  size_t next = classifier->next[node];
 
-  return cache_simulator;
+  if (prev != NO_NODE)
+    classifier->next[prev] = next;
+  else
+    classifier->head = next;
+  if (next != NO_NODE)
+    classifier->prev[next] = prev;
+  else
+    classifier->tail = prev;
 }
 
-void break_down_cache_simulator(cache_simulator_t *cache_simulator) {
-  break_down_cache(cache_simulator->cache);
-  free(cache_simulator);
+static void push_front(miss_classifier_t *classifier, size_t node) {
+  classifier->prev[node] = NO_NODE;
+  classifier->next[node] = classifier->head;
+  if (classifier->head != NO_NODE)
+    classifier->prev[classifier->head] = node;
+  else
+    classifier->tail = node;
+  classifier->head = node;
 }
 
-// Csim start
+// access block in the shadow cache, returns whether it hit
+static bool shadow_access(miss_classifier_t *classifier, size_t block) {
+  size_t slot = block_map_find(&classifier->shadow, block);
 
-int main(int argc, char *argv[]) {
-  size_t s, b, e;
-  bool is_verbose = false;
-  char *trace_file = NULL;
+  if (block_map_used(&classifier->shadow, slot)) {
+    size_t node = classifier->shadow.values[slot];
+    unlink_node(classifier, node);
+    push_front(classifier, node);
+    return true;
+  }
 
-  int opt;
-  while ((opt = getopt(argc, argv, "s:E:b:vt:")) != -1) {
-    switch (opt) {
-    case 's':
-      s = atoi(optarg);
-      break;
-    case 'E':
-      e = atoi(optarg);
-      break;
-    case 'b':
-      b = atoi(optarg);
-      break;
-    case 'v':
-      is_verbose = true;
-      break;
-    case 't':
-      trace_file = optarg;
-      break;
-    default:
-      fprintf(stderr, "Usage: %s -s <s> -E <E> -b <b> -t <tracefile> [-v]\n",
-              argv[0]);
-      exit(EXIT_FAILURE);
-    }
+  size_t node;
+  if (classifier->used < classifier->line_count) {
+    node = classifier->used++;
+  } else {
+    node = classifier->tail;
+    unlink_node(classifier, node);
+    block_map_remove(&classifier->shadow,
+                     block_map_find(&classifier->shadow,
+                                    classifier->node_block[node]));
   }
 
-  if (is_verbose)
-    printf("Debug mode: %d\n", is_verbose);
-  cache_simulator_t *csim = construct_cache_simulator(s, b, e, is_verbose);
+  classifier->node_block[node] = block;
+  push_front(classifier, node);
+  block_map_put(&classifier->shadow, block, node);
+  return false;
+}
 
-  FILE *file = fopen(trace_file, "r");
+// feed one block access of the real cache, classifying it if it missed
+void classify_access(miss_classifier_t *classifier, size_t block,
+                     bool missed) {
+  bool shadow_hit = shadow_access(classifier, block);
 
-  if (!file) {
-    perror("failed to open trace file");
-    exit(EXIT_FAILURE);
+  size_t slot = block_map_find(&classifier->seen, block);
+  bool first_touch = !block_map_used(&classifier->seen, slot);
+  if (first_touch)
+    block_map_put(&classifier->seen, block, 0);
+
+  if (!missed)
+    return;
+  if (first_touch)
+    classifier->compulsory++;
+  else if (!shadow_hit)
+    classifier->capacity++;
+  else
+    classifier->conflict++;
+}
+
+// Classification section end
+
+// Attribution section start
+
+/*
+Miss attribution charges every data access, with the misses and evictions it
+caused, to an address region and to the instruction that issued it (the last
+I record before it in the trace). Regions are either the -G ranges given on
+the command line (anything outside them is "other") or, by default, aligned
+pages of 2^page_bits bytes. Counts live in growable open-addressing tables
+so the cost per access is one hash probe per table.
+*/
+
+#define DEFAULT_PAGE_BITS 12
+
+typedef struct attribution_entry {
+  size_t key; // page number, range index or instruction address
+  unsigned long long accesses;
+  unsigned long long misses;
+  unsigned long long evictions;
+} attribution_entry_t;
+
+typedef struct attribution_table {
+  attribution_entry_t *entries;
+  unsigned char *used;
+  size_t capacity; // power of two
+  size_t count;
+} attribution_table_t;
+
+typedef struct address_range {
+  size_t start;
+  size_t end; // inclusive
+} address_range_t;
+
+typedef struct miss_attribution {
+  size_t top_n;
+  int page_bits;
+  address_range_t *ranges; // explicit regions, empty for pages
+  size_t range_count;
+
+  attribution_table_t regions;
+  attribution_table_t instructions;
+} miss_attribution_t;
+
+static void init_attribution_table(attribution_table_t *table,
+                                   size_t capacity) {
+  table->entries = checked_calloc(capacity, sizeof(attribution_entry_t));
+  table->used = checked_calloc(capacity, sizeof(unsigned char));
+  table->capacity = capacity;
+  table->count = 0;
+}
+
+static inline size_t attribution_hash(size_t key, size_t capacity) {
+  return (key * 0x9e3779b97f4a7c15ULL >> 17) & (capacity - 1);
+}
+
+static attribution_entry_t *attribution_slot(attribution_table_t *table,
+                                             size_t key);
+
+static void grow_attribution_table(attribution_table_t *table) {
+  attribution_table_t old = *table;
+  init_attribution_table(table, old.capacity * 2);
+
+  for (size_t i = 0; i < old.capacity; i++)
+    if (old.used[i])
+      *attribution_slot(table, old.entries[i].key) = old.entries[i];
+
+  free(old.entries);
+  free(old.used);
+}
+
+// entry for key, inserted zeroed if it is new
+static attribution_entry_t *attribution_slot(attribution_table_t *table,
+                                             size_t key) {
+  size_t slot = attribution_hash(key, table->capacity);
+
+  while (table->used[slot]) {
+    if (table->entries[slot].key == key)
+      return &table->entries[slot];
+    slot = (slot + 1) & (table->capacity - 1);
   }
 
-  char *line = NULL;
-  size_t len = 0;
-  ssize_t read;
+  if (4 * (table->count + 1) > 3 * table->capacity) {
+    grow_attribution_table(table);
+    return attribution_slot(table, key);
+  }
 
-  while ((read = getline(&line, &len, file)) != -1)
-    simulate_trace(csim, line);
+  table->used[slot] = 1;
+  table->count++;
+  table->entries[slot].key = key;
+  return &table->entries[slot];
+}
 
-  free(line);
-  fclose(file);
+miss_attribution_t *construct_miss_attribution(size_t top_n, int page_bits,
+                                               const address_range_t *ranges,
+                                               size_t range_count) {
+  miss_attribution_t *attribution =
+      checked_calloc(1, sizeof(miss_attribution_t));
 
-  printSummary(csim->hits, csim->misses, csim->evictions);
-  // break_down_cache_simulator(csim);
-  return 0;
+  attribution->top_n = top_n;
+  attribution->page_bits = page_bits;
+  attribution->range_count = range_count;
+  if (range_count > 0) {
+    attribution->ranges = checked_calloc(range_count, sizeof(address_range_t));
+    memcpy(attribution->ranges, ranges, sizeof(address_range_t) * range_count);
+  }
+
+  init_attribution_table(&attribution->regions, 1024);
+  init_attribution_table(&attribution->instructions, 1024);
+  return attribution;
+}
+
+void break_down_miss_attribution(miss_attribution_t *attribution) {
+  free(attribution->ranges);
+  free(attribution->regions.entries);
+  free(attribution->regions.used);
+  free(attribution->instructions.entries);
+  free(attribution->instructions.used);
+  free(attribution);
 }
+
+static size_t region_key(const miss_attribution_t *attribution,
+                         size_t address) {
+  if (attribution->range_count == 0)
+    return address >> attribution->page_bits;
+
+  for (size_t i = 0; i < attribution->range_count; i++)
+    if (address >= attribution->ranges[i].start &&
+        address <= attribution->ranges[i].end)
+      return i;
+  return attribution->range_count; // other
+}
+
+static inline void charge_entry(attribution_entry_t *entry,
+                                const access_result_t *result) {
+  entry->accesses++;
+  entry->misses += result->miss;
+  entry->evictions += result->eviction;
+}
+
+void attribute_access(miss_attribution_t *attribution, size_t address,
+                      size_t pc, bool has_pc, const access_result_t *result) {
+  charge_entry(attribution_slot(&attribution->regions,
+                                region_key(attribution, address)),
+               result);
+  if (has_pc)
+    charge_entry(attribution_slot(&attribution->instructions, pc), result);
+}
+
+static int compare_by_misses(const void *a, const void *b) {
+  const attribution_entry_t *x = a;
+  const attribution_entry_t *y = b;
+
+  if (x->misses != y->misses)
+    return x->misses < y->misses ? 1 : -1;
+  if (x->evictions != y->evictions)
+    return x->evictions < y->evictions ? 1 : -1;
+  return x->key < y->key ? -1 : x->key > y->key;
+}
+
+// used entries of table sorted by misses, the caller frees the result
+static attribution_entry_t *sorted_entries(const attribution_table_t *table) {
+  attribution_entry_t *sorted =
+      checked_calloc(table->count + 1, sizeof(attribution_entry_t));
+  size_t count = 0;
+
+  for (size_t i = 0; i < table->capacity; i++)
+    if (table->used[i])
+      sorted[count++] = table->entries[i];
+
+  qsort(sorted, count, sizeof(attribution_entry_t), compare_by_misses);
+  return sorted;
+}
+
+static void print_region_name(const miss_attribution_t *attribution,
+                              size_t key) {
+  if (attribution->range_count == 0) {
+    size_t start = key << attribution->page_bits;
+    printf("%zx-%zx", start, start + (1UL << attribution->page_bits) - 1);
+  } else if (key == attribution->range_count) {
+    printf("other");
+  } else {
+    printf("%zx-%zx", attribution->ranges[key].start,
+           attribution->ranges[key].end);
+  }
+}
+
+static void print_entry_counts(const attribution_entry_t *entry) {
+  printf(" accesses:%llu misses:%llu evictions:%llu miss_ratio:%.4f\n",
+         entry->accesses, entry->misses, entry->evictions,
+         entry->accesses ? (double)entry->misses / entry->accesses : 0.0);
+}
+
+void print_miss_attribution(const miss_attribution_t *attribution) {
+  const attribution_table_t *regions = &attribution->regions;
+  attribution_entry_t *sorted = sorted_entries(regions);
+  size_t shown = regions->count < attribution->top_n ? regions->count
+                                                     : attribution->top_n;
+
+  printf("top %zu of %zu regions by misses\n", shown, regions->count);
+  for (size_t i = 0; i < shown; i++) {
+    printf("  region ");
+    print_region_name(attribution, sorted[i].key);
+    print_entry_counts(&sorted[i]);
+  }
+  free(sorted);
+
+  const attribution_table_t *instructions = &attribution->instructions;
+  if (instructions->count == 0)
+    return;
+
+  sorted = sorted_entries(instructions);
+  shown = instructions->count < attribution->top_n ? instructions->count
+                                                   : attribution->top_n;
+
+  printf("top %zu of %zu instructions by misses\n", shown,
+         instructions->count);
+  for (size_t i = 0; i < shown; i++) {
+    printf("  pc %zx", sorted[i].key);
+    print_entry_counts(&sorted[i]);
+  }
+  free(sorted);
+}
+
+// Attribution section end
+
+// Interval section start
+
+/*
+Interval logging cuts the run into consecutive intervals and writes one
+record per interval and configuration: the hits, misses and evictions of the
+interval and its working set, the number of distinct blocks it touched.
+Intervals end every -i data accesses and, when a marker file is given, at
+every access to MARKER_START or MARKER_END, so the records line up with the
+regions tracegen brackets. Records go out as text, as CSV with a header, or
+as binary: the magic "CSIMIVL1" followed by interval_record_t structs of
+host byte order uint64_t fields.
+*/
+
+#define INTERVAL_MAGIC "CSIMIVL1"
+
+typedef enum interval_format {
+  INTERVAL_TEXT = 0,
+  INTERVAL_CSV = 1,
+  INTERVAL_BINARY = 2,
+} interval_format_t;
+
+typedef struct interval_record {
+  uint64_t s;
+  uint64_t e;
+  uint64_t b;
+  uint64_t phase;  // markers passed before the interval
+  uint64_t marked; // 1 between MARKER_START and MARKER_END
+  uint64_t end;    // data accesses from the start of the trace
+  uint64_t accesses;
+  uint64_t hits;
+  uint64_t misses;
+  uint64_t evictions;
+  uint64_t working_set; // distinct blocks touched
+} interval_record_t;
+
+typedef struct interval_log {
+  FILE *file;
+  interval_format_t format;
+  unsigned long long length; // data accesses per interval, 0 for markers only
+
+  bool has_markers;
+  size_t marker_start;
+  size_t marker_end;
+} interval_log_t;
+
+interval_format_t parse_interval_format(const char *name) {
+  if (strcmp(name, "text") == 0)
+    return INTERVAL_TEXT;
+  if (strcmp(name, "csv") == 0)
+    return INTERVAL_CSV;
+  if (strcmp(name, "binary") == 0)
+    return INTERVAL_BINARY;
+  fprintf(stderr, "unknown interval format '%s'\n", name);
+  exit(EXIT_FAILURE);
+}
+
+// read the two marker addresses tracegen leaves in its .marker file
+void read_marker_file(interval_log_t *log, const char *marker_file) {
+  FILE *file = fopen(marker_file, "r");
+  if (!file) {
+    perror("failed to open marker file");
+    exit(EXIT_FAILURE);
+  }
+  if (fscanf(file, "%zx %zx", &log->marker_start, &log->marker_end) != 2) {
+    fprintf(stderr, "%s: expected two hex marker addresses\n", marker_file);
+    exit(EXIT_FAILURE);
+  }
+  fclose(file);
+  log->has_markers = true;
+}
+
+// output_file NULL writes to stdout
+void open_interval_log(interval_log_t *log, const char *output_file) {
+  log->file = stdout;
+  if (output_file) {
+    log->file = fopen(output_file, "wb");
+    if (!log->file) {
+      perror("failed to create interval file");
+      exit(EXIT_FAILURE);
+    }
+  }
+
+  if (log->format == INTERVAL_CSV)
+    fprintf(log->file, "s,E,b,phase,marked,end,accesses,hits,misses,"
+                       "evictions,working_set\n");
+  else if (log->format == INTERVAL_BINARY)
+    fwrite(INTERVAL_MAGIC, 1, strlen(INTERVAL_MAGIC), log->file);
+}
+
+void write_interval_record(interval_log_t *log,
+                           const interval_record_t *record) {
+  switch (log->format) {
+  case INTERVAL_TEXT:
+    fprintf(log->file,
+            "interval s:%llu E:%llu b:%llu phase:%llu marked:%llu end:%llu "
+            "accesses:%llu hits:%llu misses:%llu evictions:%llu "
+            "working_set:%llu\n",
+            (unsigned long long)record->s, (unsigned long long)record->e,
+            (unsigned long long)record->b, (unsigned long long)record->phase,
+            (unsigned long long)record->marked,
+            (unsigned long long)record->end,
+            (unsigned long long)record->accesses,
+            (unsigned long long)record->hits,
+            (unsigned long long)record->misses,
+            (unsigned long long)record->evictions,
+            (unsigned long long)record->working_set);
+    break;
+  case INTERVAL_CSV:
+    fprintf(log->file, "%llu,%llu,%llu,%llu,%llu,%llu,%llu,%llu,%llu,%llu,"
+                       "%llu\n",
+            (unsigned long long)record->s, (unsigned long long)record->e,
+            (unsigned long long)record->b, (unsigned long long)record->phase,
+            (unsigned long long)record->marked,
+            (unsigned long long)record->end,
+            (unsigned long long)record->accesses,
+            (unsigned long long)record->hits,
+            (unsigned long long)record->misses,
+            (unsigned long long)record->evictions,
+            (unsigned long long)record->working_set);
+    break;
+  case INTERVAL_BINARY:
+    fwrite(record, sizeof(interval_record_t), 1, log->file);
+    break;
+  }
+}
+
+void close_interval_log(interval_log_t *log) {
+  if (log->file != stdout && fclose(log->file) != 0) {
+    perror("failed to write interval file");
+    exit(EXIT_FAILURE);
+  }
+  log->file = NULL;
+}
+
+// Interval section end
+
+// Prefetch section start
+
+/*
+A prefetcher watches the demand accesses of one cache and loads the blocks
+it predicts into it. Three models are provided:
+
+  next    on a miss, or on the first use of a prefetched line, fetch the
+          next degree blocks (tagged next-line prefetching)
+  stride  a direct mapped table keyed by the issuing instruction (the last
+          I record) learns a constant stride and, once it repeated twice,
+          fetches degree strides ahead
+  stream  misses within STREAM_WINDOW blocks of a tracked stream confirm its
+          direction; a confirmed stream runs degree blocks ahead of it
+
+Prefetches wait in a queue for latency data accesses before they land, so a
+demand access to a block still in flight counts as late (and is an ordinary
+miss). Landed lines carry a prefetched bit until their first demand hit
+(useful) or their eviction (useless). Blocks a prefetch evicted are
+remembered for a while; a demand miss on one of them counts as pollution.
+Prefetch fills and the write-backs of their dirty victims count towards
+bytes_read, bytes_written and dirty_evictions; hits, misses and evictions
+stay demand only.
+*/
+
+#define STRIDE_TABLE_SIZE 256
+#define STRIDE_CONFIDENT 2
+#define STREAM_COUNT 16
+#define STREAM_WINDOW 4
+#define STREAM_CONFIDENT 2
+#define PREFETCH_QUEUE_SIZE 64
+
+typedef enum prefetch_kind {
+  PREFETCH_NONE = 0,
+  PREFETCH_NEXT_LINE = 1,
+  PREFETCH_STRIDE = 2,
+  PREFETCH_STREAM = 3,
+} prefetch_kind_t;
+
+static const char *prefetch_names[] = {
+    [PREFETCH_NONE] = "none",
+    [PREFETCH_NEXT_LINE] = "next",
+    [PREFETCH_STRIDE] = "stride",
+    [PREFETCH_STREAM] = "stream",
+};
+
+typedef struct stride_entry {
+  size_t pc;
+  size_t last_address;
+  long long stride;
+  int confidence;
+} stride_entry_t;
+
+typedef struct stream_entry {
+  size_t last_block;
+  int direction; // +1 or -1 once confirmed
+  int confidence;
+  unsigned long long last_use; // for replacing the oldest stream
+} stream_entry_t;
+
+typedef struct prefetcher {
+  prefetch_kind_t kind;
+  size_t degree;
+  unsigned long long latency; // data accesses until a prefetch lands
+  unsigned long long now;     // data accesses so far
+
+  stride_entry_t strides[STRIDE_TABLE_SIZE];
+  stream_entry_t streams[STREAM_COUNT];
+
+  // in-flight prefetches, oldest first, in a ring
+  size_t queue_blocks[PREFETCH_QUEUE_SIZE];
+  unsigned long long queue_ready[PREFETCH_QUEUE_SIZE];
+  size_t queue_head;
+  size_t queue_count;
+
+  block_map_t displaced; // blocks evicted by prefetches
+  size_t displaced_limit;
+
+  unsigned long long issued;
+  unsigned long long useful;
+  unsigned long long late;
+  unsigned long long useless;
+  unsigned long long polluting;
+} prefetcher_t;
+
+prefetcher_t *construct_prefetcher(prefetch_kind_t kind, size_t degree,
+                                   unsigned long long latency,
+                                   size_t line_count) {
+  prefetcher_t *prefetcher = checked_calloc(1, sizeof(prefetcher_t));
+
+  prefetcher->kind = kind;
+  prefetcher->degree = degree;
+  prefetcher->latency = latency;
+  // past a cache's worth of later evictions a displaced block would have
+  // gone anyway
+  prefetcher->displaced_limit = line_count;
+  init_block_map(&prefetcher->displaced, 2 * line_count);
+  return prefetcher;
+}
+
+void break_down_prefetcher(prefetcher_t *prefetcher) {
+  free_block_map(&prefetcher->displaced);
+  free(prefetcher);
+}
+
+// index of block in the in-flight queue, or queue_count
+static size_t find_in_flight(const prefetcher_t *prefetcher, size_t block) {
+  size_t i = 0;
+  for (; i < prefetcher->queue_count; i++)
+    if (prefetcher->queue_blocks[(prefetcher->queue_head + i) %
+                                 PREFETCH_QUEUE_SIZE] == block)
+      break;
+  return i;
+}
+
+static void remove_in_flight(prefetcher_t *prefetcher, size_t position) {
+  // keep the ring in issue order by closing the gap
+  for (size_t i = position; i + 1 < prefetcher->queue_count; i++) {
+    size_t to = (prefetcher->queue_head + i) % PREFETCH_QUEUE_SIZE;
+    size_t from = (to + 1) % PREFETCH_QUEUE_SIZE;
+    prefetcher->queue_blocks[to] = prefetcher->queue_blocks[from];
+    prefetcher->queue_ready[to] = prefetcher->queue_ready[from];
+  }
+  prefetcher->queue_count--;
+}
+
+static void land_prefetch(prefetcher_t *prefetcher, cache_t *cache,
+                          size_t block, access_result_t *result) {
+  bool did_evict, victim_dirty = false, victim_unused = false;
+  size_t victim = 0;
+
+  if (!prefetch_block(cache, block << cache->b, &did_evict, &victim,
+                      &victim_dirty, &victim_unused))
+    return;
+
+  result->bytes_read += 1UL << cache->b;
+  if (!did_evict)
+    return;
+  if (victim_dirty) {
+    result->dirty_eviction += 1;
+    result->bytes_written += 1UL << cache->b;
+  }
+  if (victim_unused)
+    prefetcher->useless++;
+
+  if (prefetcher->displaced.count >= prefetcher->displaced_limit)
+    clear_block_map(&prefetcher->displaced);
+  block_map_put(&prefetcher->displaced, victim >> cache->b, 0);
+}
+
+// land every prefetch whose latency has passed
+void advance_prefetcher(prefetcher_t *prefetcher, cache_t *cache,
+                        access_result_t *result) {
+  prefetcher->now++;
+  while (prefetcher->queue_count > 0 &&
+         prefetcher->queue_ready[prefetcher->queue_head] <= prefetcher->now) {
+    size_t block = prefetcher->queue_blocks[prefetcher->queue_head];
+    prefetcher->queue_head = (prefetcher->queue_head + 1) % PREFETCH_QUEUE_SIZE;
+    prefetcher->queue_count--;
+    land_prefetch(prefetcher, cache, block, result);
+  }
+}
+
+static void issue_prefetch(prefetcher_t *prefetcher, cache_t *cache,
+                           size_t block, access_result_t *result) {
+  size_t line;
+  if (probe_set_for_memory(cache, set_index_of(cache, block << cache->b),
+                           block >> cache->s, &line) == PROBE_HIT ||
+      find_in_flight(prefetcher, block) < prefetcher->queue_count)
+    return;
+
+  prefetcher->issued++;
+  if (prefetcher->latency == 0) {
+    land_prefetch(prefetcher, cache, block, result);
+    return;
+  }
+
+  // a full queue drops its oldest request
+  if (prefetcher->queue_count == PREFETCH_QUEUE_SIZE)
+    remove_in_flight(prefetcher, 0);
+  size_t tail = (prefetcher->queue_head + prefetcher->queue_count) %
+                PREFETCH_QUEUE_SIZE;
+  prefetcher->queue_blocks[tail] = block;
+  prefetcher->queue_ready[tail] = prefetcher->now + prefetcher->latency;
+  prefetcher->queue_count++;
+}
+
+// account a demand access to block before the cache sees it
+void prefetcher_demand(prefetcher_t *prefetcher, size_t block) {
+  size_t position = find_in_flight(prefetcher, block);
+  if (position < prefetcher->queue_count) {
+    prefetcher->late++;
+    remove_in_flight(prefetcher, position);
+  }
+}
+
+static void train_stride(prefetcher_t *prefetcher, cache_t *cache,
+                         size_t address, size_t pc, access_result_t *result) {
+  stride_entry_t *entry =
+      &prefetcher->strides[(pc ^ (pc >> 8)) % STRIDE_TABLE_SIZE];
+
+  if (entry->pc != pc || entry->last_address == 0) {
+    entry->pc = pc;
+    entry->stride = 0;
+    entry->confidence = 0;
+  } else {
+    long long stride = (long long)(address - entry->last_address);
+    if (stride != 0 && stride == entry->stride) {
+      if (entry->confidence < STRIDE_CONFIDENT)
+        entry->confidence++;
+    } else {
+      entry->stride = stride;
+      entry->confidence = 0;
+    }
+  }
+  entry->last_address = address;
+
+  if (entry->confidence < STRIDE_CONFIDENT)
+    return;
+  for (size_t k = 1; k <= prefetcher->degree; k++)
+    issue_prefetch(prefetcher, cache,
+                   (address + k * entry->stride) >> cache->b, result);
+}
+
+static void train_stream(prefetcher_t *prefetcher, cache_t *cache,
+                         size_t block, access_result_t *result) {
+  stream_entry_t *stream = NULL;
+  stream_entry_t *oldest = &prefetcher->streams[0];
+
+  for (size_t i = 0; i < STREAM_COUNT; i++) {
+    stream_entry_t *candidate = &prefetcher->streams[i];
+    long long distance = (long long)(block - candidate->last_block);
+    if (candidate->last_use && distance != 0 &&
+        distance >= -STREAM_WINDOW && distance <= STREAM_WINDOW) {
+      stream = candidate;
+      break;
+    }
+    if (candidate->last_use < oldest->last_use)
+      oldest = candidate;
+  }
+
+  if (!stream) {
+    *oldest = (stream_entry_t){.last_block = block,
+                               .last_use = prefetcher->now};
+    return;
+  }
+
+  int direction = block > stream->last_block ? 1 : -1;
+  if (direction == stream->direction) {
+    if (stream->confidence < STREAM_CONFIDENT)
+      stream->confidence++;
+  } else {
+    stream->direction = direction;
+    stream->confidence = 0;
+  }
+  stream->last_block = block;
+  stream->last_use = prefetcher->now;
+
+  if (stream->confidence < STREAM_CONFIDENT)
+    return;
+  for (size_t k = 1; k <= prefetcher->degree; k++)
+    issue_prefetch(prefetcher, cache, block + direction * (long long)k,
+                   result);
+}
+
+// learn from the demand access to block and issue what it predicts
+void train_prefetcher(prefetcher_t *prefetcher, cache_t *cache,
+                      size_t address, size_t pc, bool missed,
+                      access_result_t *result) {
+  size_t block = address >> cache->b;
+  bool prefetch_hit = result->prefetch_hit > 0;
+
+  if (result->prefetch_hit)
+    prefetcher->useful += result->prefetch_hit;
+  prefetcher->useless += result->prefetch_evicted;
+  result->prefetch_hit = 0;
+  result->prefetch_evicted = 0;
+
+  if (missed) {
+    size_t slot = block_map_find(&prefetcher->displaced, block);
+    if (block_map_used(&prefetcher->displaced, slot)) {
+      prefetcher->polluting++;
+      block_map_remove(&prefetcher->displaced, slot);
+    }
+  }
+
+  switch (prefetcher->kind) {
+  case PREFETCH_NEXT_LINE:
+    if (missed || prefetch_hit)
+      for (size_t k = 1; k <= prefetcher->degree; k++)
+        issue_prefetch(prefetcher, cache, block + k, result);
+    break;
+  case PREFETCH_STRIDE:
+    train_stride(prefetcher, cache, address, pc, result);
+    break;
+  case PREFETCH_STREAM:
+    if (missed || prefetch_hit)
+      train_stream(prefetcher, cache, block, result);
+    break;
+  case PREFETCH_NONE:
+    break;
+  }
+}
+
+// Prefetch section end
+
+// MSHR section start
+
+/*
+Miss status holding registers track the blocks a cache is still fetching.
+Every miss holds an entry for window data accesses, standing in for the
+miss latency. Any later access to a block whose entry is still held would,
+on real hardware, wait on that fill instead of fetching again: it is
+counted as merged into the outstanding miss. A miss that finds every entry
+busy waits for the earliest one to retire and is counted as a full stall.
+*/
+
+typedef struct mshr {
+  size_t entries;
+  unsigned long long window; // accesses a miss stays outstanding
+  unsigned long long now;    // data accesses so far
+
+  size_t *blocks;              // [entries]
+  unsigned long long *ready;   // [entries], free once now reaches it
+
+  unsigned long long allocations;
+  unsigned long long merged;
+  unsigned long long full_stalls;
+} mshr_t;
+
+mshr_t *construct_mshr(size_t entries, unsigned long long window) {
+  if (entries == 0 || window == 0) {
+    fprintf(stderr, "MSHRs need at least one entry and a window\n");
+    exit(EXIT_FAILURE);
+  }
+
+  mshr_t *mshr = checked_calloc(1, sizeof(mshr_t));
+  mshr->entries = entries;
+  mshr->window = window;
+  mshr->blocks = checked_calloc(entries, sizeof(size_t));
+  mshr->ready = checked_calloc(entries, sizeof(unsigned long long));
+  return mshr;
+}
+
+void break_down_mshr(mshr_t *mshr) {
+  free(mshr->blocks);
+  free(mshr->ready);
+  free(mshr);
+}
+
+// one block access of the current data access, missed or not
+void mshr_access(mshr_t *mshr, size_t block, bool missed) {
+  size_t free_entry = mshr->entries;
+  size_t earliest = 0;
+
+  for (size_t i = 0; i < mshr->entries; i++) {
+    if (mshr->ready[i] > mshr->now) {
+      if (mshr->blocks[i] == block) {
+        mshr->merged++;
+        return;
+      }
+      if (mshr->ready[i] < mshr->ready[earliest])
+        earliest = i;
+    } else if (free_entry == mshr->entries) {
+      free_entry = i;
+    }
+  }
+
+  if (!missed)
+    return;
+
+  unsigned long long start = mshr->now;
+  if (free_entry == mshr->entries) {
+    mshr->full_stalls++;
+    free_entry = earliest;
+    start = mshr->ready[earliest];
+  }
+  mshr->blocks[free_entry] = block;
+  mshr->ready[free_entry] = start + mshr->window;
+  mshr->allocations++;
+}
+
+// MSHR section end
+
+// Latency section start
+
+/*
+The latency model turns the level each access was served from into time.
+An access served by level k (the levels after the last cache being memory)
+costs the latencies of every level it probed, L1 through k, and a block
+read from memory additionally occupies the memory bus for block size /
+bytes per cycle cycles. AMAT is the mean of those costs, and the stall
+cycles are everything beyond the L1 hit time, paid one miss at a time.
+
+Misses can overlap. A miss opens an epoch that lasts window accesses;
+later misses inside it are in flight together, so the epoch stalls for its
+longest miss plus the bus time of any further blocks it read from memory.
+With a window of 1 every miss is its own epoch.
+*/
+
+typedef struct latency_model {
+  size_t level_count;          // caches, memory is level level_count
+  unsigned long long *latency; // [level_count + 1], cycles per level
+  double bytes_per_cycle;      // memory bandwidth, 0 for unlimited
+  unsigned long long transfer; // bus cycles per block
+  unsigned long long window;   // accesses one epoch spans
+
+  unsigned long long accesses;
+  unsigned long long access_cycles; // sum of access costs
+  unsigned long long stall_cycles;  // misses paid one at a time
+  unsigned long long mlp_stall_cycles;
+
+  bool in_epoch;
+  unsigned long long epoch_end;   // first access past the epoch
+  unsigned long long epoch_stall; // longest miss of the epoch
+  unsigned long long epoch_blocks; // blocks read from memory in the epoch
+} latency_model_t;
+
+// parse "-y <L1>[,<L2>...],<memory>" into level_count + 1 latencies
+latency_model_t *construct_latency_model(const char *latencies,
+                                         size_t level_count, int b,
+                                         double bytes_per_cycle,
+                                         unsigned long long window) {
+  latency_model_t *model = checked_calloc(1, sizeof(latency_model_t));
+  model->level_count = level_count;
+  model->latency =
+      checked_calloc(level_count + 1, sizeof(unsigned long long));
+
+  const char *p = latencies;
+  for (size_t i = 0; i <= level_count; i++) {
+    char *end;
+    model->latency[i] = strtoull(p, &end, 0);
+    if (end == p || (i < level_count ? *end != ',' : *end != '\0')) {
+      fprintf(stderr, "bad latencies '%s', expected %zu cache latencies "
+                      "and the memory latency\n",
+              latencies, level_count);
+      exit(EXIT_FAILURE);
+    }
+    p = end + 1;
+  }
+
+  model->bytes_per_cycle = bytes_per_cycle;
+  model->transfer = bytes_per_cycle > 0
+                        ? (unsigned long long)((1UL << b) / bytes_per_cycle)
+                        : 0;
+  model->window = window ? window : 1;
+  return model;
+}
+
+void break_down_latency_model(latency_model_t *model) {
+  free(model->latency);
+  free(model);
+}
+
+static void close_epoch(latency_model_t *model) {
+  if (!model->in_epoch)
+    return;
+  model->mlp_stall_cycles += model->epoch_stall;
+  if (model->epoch_blocks > 1)
+    model->mlp_stall_cycles += (model->epoch_blocks - 1) * model->transfer;
+  model->in_epoch = false;
+}
+
+// one block access served by level (level_count for memory)
+void record_latency(latency_model_t *model, size_t level) {
+  unsigned long long cost = 0;
+  for (size_t i = 0; i <= level; i++)
+    cost += model->latency[i];
+  bool from_memory = level == model->level_count;
+  if (from_memory)
+    cost += model->transfer;
+
+  model->accesses++;
+  model->access_cycles += cost;
+  if (level == 0)
+    return;
+
+  unsigned long long stall = cost - model->latency[0];
+  model->stall_cycles += stall;
+
+  if (model->in_epoch && model->accesses > model->epoch_end)
+    close_epoch(model);
+  if (!model->in_epoch) {
+    model->in_epoch = true;
+    model->epoch_end = model->accesses + model->window - 1;
+    model->epoch_stall = 0;
+    model->epoch_blocks = 0;
+  }
+  // the first memory block's bus time is part of its own stall
+  if (stall > model->epoch_stall)
+    model->epoch_stall = stall;
+  model->epoch_blocks += from_memory;
+}
+
+void print_latency_summary(latency_model_t *model, const char *prefix) {
+  close_epoch(model);
+
+  unsigned long long accesses = model->accesses;
+  printf("%samat:%.3f stall_cycles:%llu mlp_stall_cycles:%llu "
+         "cycles:%llu\n",
+         prefix, accesses ? (double)model->access_cycles / accesses : 0.0,
+         model->stall_cycles, model->mlp_stall_cycles,
+         accesses * model->latency[0] + model->mlp_stall_cycles);
+}
+
+// Latency section end
+
+// Sampling section start
+
+/*
+Sampling trades exactness for speed in two ways that combine freely. Set
+sampling splits the sets into strata of set_period consecutive sets and
+simulates one set per stratum, picked pseudo-randomly from the seed (-r);
+the other sets are never touched. A fixed pick such as every
+set_period-th set aliases with power of two strides, which pile all their
+misses onto or away from it. Time sampling cuts the trace into periods of
+period data accesses, each starting with warmup accesses that only warm
+the cache, followed by detail accesses that are counted; the rest of the
+period is skipped without simulating anything.
+
+The counted misses fall into units, one per detail window or, without time
+sampling, one per sampled set. They are scaled up by the sampled fraction
+(the set period times the share of references inside detail windows) to
+estimate the misses of the whole trace, and the variance of the misses per
+unit gives a 95% confidence interval from Student's t. Scaling the misses
+rather than taking the sampled miss rate keeps strata that see little
+traffic from biasing the estimate. With fewer than SAMPLE_MIN_UNITS units
+the sample variance says too little about sets it did not see (a few hot
+sets can carry most misses), and no interval is reported.
+*/
+
+#define SAMPLE_Z95 1.96
+#define SAMPLE_MIN_UNITS 20
+
+typedef struct sampling {
+  size_t set_period;         // 1 simulates every set
+  unsigned long long period; // 0 for no time sampling
+  unsigned long long warmup;
+  unsigned long long detail;
+  unsigned long long position; // data accesses into the current period
+
+  unsigned long long references;        // every data reference of the trace
+  unsigned long long detail_references; // of those, in detail windows
+  unsigned long long unit_references; // of the unit being collected
+  unsigned long long unit_misses;
+  unsigned long long *set_references; // [set_count] without time sampling
+  unsigned long long *set_misses;
+  unsigned char *sampled_sets;        // [set_count], one set per stratum
+
+  // sums over finished units of references a and misses m
+  unsigned long long units;
+  double sum_a, sum_m, sum_mm;
+} sampling_t;
+
+sampling_t *construct_sampling(size_t set_period, unsigned long long period,
+                               unsigned long long detail,
+                               unsigned long long warmup, size_t set_count,
+                               unsigned long long seed) {
+  if (period > 0 && warmup + detail > period) {
+    fprintf(stderr, "warm-up and detail windows exceed the period\n");
+    exit(EXIT_FAILURE);
+  }
+
+  sampling_t *sampling = checked_calloc(1, sizeof(sampling_t));
+  sampling->set_period = set_period ? set_period : 1;
+  sampling->period = period;
+  sampling->detail = detail;
+  sampling->warmup = warmup;
+
+  sampling->sampled_sets = checked_calloc(set_count, sizeof(unsigned char));
+  for (size_t first = 0; first < set_count; first += sampling->set_period) {
+    size_t size = set_count - first < sampling->set_period
+                      ? set_count - first
+                      : sampling->set_period;
+    // splitmix64 of (seed, stratum)
+    unsigned long long z = seed + (first + 1) * 0x9e3779b97f4a7c15ULL;
+    z = (z ^ (z >> 30)) * 0xbf58476d1ce4e5b9ULL;
+    z = (z ^ (z >> 27)) * 0x94d049bb133111ebULL;
+    sampling->sampled_sets[first + (z ^ (z >> 31)) % size] = 1;
+  }
+
+  if (period == 0) {
+    sampling->set_references =
+        checked_calloc(set_count, sizeof(unsigned long long));
+    sampling->set_misses =
+        checked_calloc(set_count, sizeof(unsigned long long));
+  }
+  return sampling;
+}
+
+void break_down_sampling(sampling_t *sampling) {
+  free(sampling->set_references);
+  free(sampling->set_misses);
+  free(sampling->sampled_sets);
+  free(sampling);
+}
+
+static inline bool set_sampled(const sampling_t *sampling, size_t set_index) {
+  return sampling->sampled_sets[set_index];
+}
+
+// two-sided 95% quantile of Student's t with df degrees of freedom
+static double t_quantile95(size_t df) {
+  static const double table[] = {
+      0,     12.706, 4.303, 3.182, 2.776, 2.571, 2.447, 2.365,
+      2.306, 2.262,  2.228, 2.201, 2.179, 2.160, 2.145, 2.131,
+      2.120, 2.110,  2.101, 2.093, 2.086, 2.080, 2.074, 2.069,
+      2.064, 2.060,  2.056, 2.052, 2.048, 2.045, 2.042,
+  };
+  if (df < sizeof(table) / sizeof(table[0]))
+    return table[df];
+
+  // Cornish-Fisher expansion around the normal quantile
+  double z = SAMPLE_Z95;
+  return z + (z * z * z + z) / (4.0 * df) +
+         (5 * pow(z, 5) + 16 * z * z * z + 3 * z) / (96.0 * df * df);
+}
+
+static void add_sample_unit(sampling_t *sampling, unsigned long long a,
+                            double m) {
+  if (a == 0)
+    return;
+  sampling->units++;
+  sampling->sum_a += a;
+  sampling->sum_m += m;
+  sampling->sum_mm += (double)m * m;
+}
+
+// where the next data access falls in its period; returns false when it
+// is skipped, otherwise whether it is counted goes to counted
+bool sample_access(sampling_t *sampling, bool *counted) {
+  if (sampling->period == 0) {
+    *counted = true;
+    return true;
+  }
+
+  unsigned long long position = sampling->position;
+  sampling->position = (position + 1) % sampling->period;
+
+  if (position == sampling->warmup + sampling->detail) {
+    add_sample_unit(sampling, sampling->unit_references,
+                    sampling->unit_misses);
+    sampling->unit_references = 0;
+    sampling->unit_misses = 0;
+  }
+  *counted = position >= sampling->warmup;
+  return position < sampling->warmup + sampling->detail;
+}
+
+// count references of set_index that missed misses times
+void sample_references(sampling_t *sampling, size_t set_index,
+                       unsigned long long references,
+                       unsigned long long misses) {
+  if (sampling->period > 0) {
+    sampling->unit_references += references;
+    sampling->unit_misses += misses;
+  } else {
+    sampling->set_references[set_index] += references;
+    sampling->set_misses[set_index] += misses;
+  }
+}
+
+void print_sampling_summary(sampling_t *sampling, size_t set_count,
+                            const char *prefix) {
+  if (sampling->period > 0) {
+    add_sample_unit(sampling, sampling->unit_references,
+                    sampling->unit_misses);
+    sampling->unit_references = 0;
+    sampling->unit_misses = 0;
+  } else {
+    // a short last stratum stands for fewer sets than set_period
+    for (size_t set = 0; set < set_count; set++) {
+      if (!sampling->sampled_sets[set])
+        continue;
+      size_t first = set - set % sampling->set_period;
+      size_t size = set_count - first < sampling->set_period
+                        ? set_count - first
+                        : sampling->set_period;
+      add_sample_unit(sampling, sampling->set_references[set],
+                      (double)sampling->set_misses[set] * size /
+                          sampling->set_period);
+    }
+  }
+
+  double n = sampling->units;
+  double total = sampling->references;
+  double expansion = sampling->detail_references
+                         ? sampling->set_period * total /
+                               sampling->detail_references
+                         : 0;
+  double misses = expansion * sampling->sum_m;
+
+  printf("%ssampled_references:%.0f of %llu units:%llu miss_rate:%.6f ",
+         prefix, sampling->sum_a, sampling->references, sampling->units,
+         total ? misses / total : 0);
+  if (sampling->units >= SAMPLE_MIN_UNITS) {
+    double variance =
+        (sampling->sum_mm - sampling->sum_m * sampling->sum_m / n) / (n - 1);
+    double interval = t_quantile95(sampling->units - 1) * expansion *
+                      sqrt(n * (variance > 0 ? variance : 0));
+    printf("ci95:%.6f ", total ? interval / total : 0);
+  } else {
+    printf("ci95:none ");
+  }
+  printf("est_hits:%.0f est_misses:%.0f\n", total - misses, misses);
+}
+
+// Sampling section end
+
+// Csim start
+
+typedef struct cache_config {
+  size_t s;
+  size_t e;
+  size_t b;
+} cache_config_t;
+
+typedef struct cache_simulator {
+  // int e;          // associativity
+  bool is_verbose; // 0 -> concise
+
+  unsigned long long hits;
+  unsigned long long misses;
+  unsigned long long evictions;
+
+  unsigned long long dirty_evictions;
+  unsigned long long bytes_read;    // from the next level
+  unsigned long long bytes_written; // to the next level
+
+  bool split_unaligned;
+  unsigned long long split_accesses; // accesses spanning several blocks
+  unsigned long long split_blocks;   // blocks past the first of those
+  unsigned long long split_misses;   // misses on those extra blocks
+
+  unsigned long long victim_hits; // misses the victim cache served
+
+  // only blocks mapping to sets [first_set, last_set) are simulated
+  size_t first_set;
+  size_t last_set;
+
+  miss_attribution_t *attribution; // NULL unless -R was given
+  miss_classifier_t *classifier;   // NULL unless -C was given
+  prefetcher_t *prefetcher;        // NULL unless -f was given
+  latency_model_t *latency;        // NULL unless -y was given
+  sampling_t *sampling;            // NULL unless -g or -z was given
+  mshr_t *mshr;                    // NULL unless -M was given
+
+  // NULL unless -i or -m was given
+  interval_log_t *intervals;
+  unsigned long long accesses;       // data accesses so far
+  unsigned long long interval_start; // counters when the interval began
+  unsigned long long interval_hits;
+  unsigned long long interval_misses;
+  unsigned long long interval_evictions;
+  unsigned long long phase; // markers passed
+  bool marked;              // inside MARKER_START .. MARKER_END
+  block_map_t interval_blocks;
+
+  size_t last_pc;                   // address of the last I record
+  bool has_pc;
+
+  cache_t *cache;
+} cache_simulator_t;
+
+static const char operation_chars[] = {
+    [INSTRUCTION_LOAD] = 'I',
+    [DATA_LOAD] = 'L',
+    [DATA_STORE] = 'S',
+    [MODIFY] = 'M',
+};
+
+// log the interval ending now and start the next one
+void end_interval(cache_simulator_t *cache_simulator) {
+  cache_t *cache = cache_simulator->cache;
+  interval_record_t record = {
+      .s = cache->s,
+      .e = cache->line_count,
+      .b = cache->b,
+      .phase = cache_simulator->phase,
+      .marked = cache_simulator->marked,
+      .end = cache_simulator->accesses,
+      .accesses = cache_simulator->accesses - cache_simulator->interval_start,
+      .hits = cache_simulator->hits - cache_simulator->interval_hits,
+      .misses = cache_simulator->misses - cache_simulator->interval_misses,
+      .evictions =
+          cache_simulator->evictions - cache_simulator->interval_evictions,
+      .working_set = cache_simulator->interval_blocks.count,
+  };
+  write_interval_record(cache_simulator->intervals, &record);
+
+  cache_simulator->interval_start = cache_simulator->accesses;
+  cache_simulator->interval_hits = cache_simulator->hits;
+  cache_simulator->interval_misses = cache_simulator->misses;
+  cache_simulator->interval_evictions = cache_simulator->evictions;
+  clear_block_map(&cache_simulator->interval_blocks);
+}
+
+void simulate_trace(cache_simulator_t *cache_simulator,
+                    const trace_record_t *record) {
+  // instruction fetches are not simulated, they only name the next access
+  if (record->operation == INSTRUCTION_LOAD) {
+    cache_simulator->last_pc = record->address;
+    cache_simulator->has_pc = true;
+    return;
+  }
+
+  // a marker store closes the interval before it and opens a new phase
+  interval_log_t *intervals = cache_simulator->intervals;
+  if (intervals && intervals->has_markers &&
+      (record->address == intervals->marker_start ||
+       record->address == intervals->marker_end)) {
+    if (cache_simulator->accesses > cache_simulator->interval_start)
+      end_interval(cache_simulator);
+    cache_simulator->phase++;
+    cache_simulator->marked = record->address == intervals->marker_start;
+  }
+
+  cache_t *cache = cache_simulator->cache;
+  size_t block_size = 1UL << cache->b;
+  size_t blocks = cache_simulator->split_unaligned
+                      ? blocks_touched(record->address, record->size, cache->b)
+                      : 1;
+
+  // skipped accesses touch nothing, warm-up ones are simulated uncounted
+  sampling_t *sampling = cache_simulator->sampling;
+  bool counted = true;
+  if (sampling) {
+    sampling->references += blocks * (record->operation == MODIFY ? 2 : 1);
+    if (!sample_access(sampling, &counted))
+      return;
+    if (counted)
+      sampling->detail_references +=
+          blocks * (record->operation == MODIFY ? 2 : 1);
+  }
+
+  access_result_t result = {0};
+  size_t address = record->address;
+  size_t remaining = record->size;
+
+  prefetcher_t *prefetcher = cache_simulator->prefetcher;
+  if (prefetcher)
+    advance_prefetcher(prefetcher, cache, &result);
+  if (cache_simulator->mshr)
+    cache_simulator->mshr->now++;
+
+  for (size_t i = 0; i < blocks; i++) {
+    size_t block_end = (address | (block_size - 1)) + 1;
+    size_t chunk = i + 1 == blocks ? remaining : block_end - address;
+    size_t set_index = set_index_of(cache, address);
+
+    if (set_index >= cache_simulator->first_set &&
+        set_index < cache_simulator->last_set &&
+        (!sampling || set_sampled(sampling, set_index))) {
+      unsigned int misses_before = result.miss;
+      if (prefetcher)
+        prefetcher_demand(prefetcher, address >> cache->b);
+      cache->kernel(cache, record->operation, address, chunk, &result);
+      if (prefetcher)
+        train_prefetcher(prefetcher, cache, address, cache_simulator->last_pc,
+                         result.miss != misses_before, &result);
+
+      if (cache_simulator->mshr)
+        mshr_access(cache_simulator->mshr, address >> cache->b,
+                    result.miss != misses_before);
+
+      if (sampling && counted)
+        sample_references(sampling, set_index,
+                          record->operation == MODIFY ? 2 : 1,
+                          result.miss - misses_before);
+
+      if (cache_simulator->latency) {
+        record_latency(cache_simulator->latency,
+                       result.miss != misses_before);
+        if (record->operation == MODIFY)
+          record_latency(cache_simulator->latency, 0);
+      }
+
+      if (cache_simulator->classifier)
+        classify_access(cache_simulator->classifier, address >> cache->b,
+                        result.miss != misses_before);
+
+      if (intervals)
+        block_map_put(&cache_simulator->interval_blocks, address >> cache->b,
+                      0);
+
+      if (i == 1)
+        cache_simulator->split_accesses++;
+      if (i > 0) {
+        cache_simulator->split_blocks++;
+        cache_simulator->split_misses += result.miss - misses_before;
+      }
+    }
+
+    address = block_end;
+    remaining -= chunk;
+  }
+
+  if (!counted)
+    result = (access_result_t){0};
+
+  if (cache_simulator->attribution)
+    attribute_access(cache_simulator->attribution, record->address,
+                     cache_simulator->last_pc, cache_simulator->has_pc,
+                     &result);
+
+  if (cache_simulator->is_verbose) {
+    printf("%c %zx,%u", operation_chars[record->operation], record->address,
+           record->size);
+    for (unsigned int i = 0; i < result.miss; i++)
+      printf(" miss");
+    for (unsigned int i = 0; i < result.eviction; i++)
+      printf(" eviction");
+    for (unsigned int i = 0; i < result.hit; i++)
+      printf(" hit");
+    printf("\n");
+  }
+
+  cache_simulator->misses += result.miss;
+  cache_simulator->hits += result.hit;
+  cache_simulator->evictions += result.eviction;
+  cache_simulator->dirty_evictions += result.dirty_eviction;
+  cache_simulator->bytes_read += result.bytes_read;
+  cache_simulator->bytes_written += result.bytes_written;
+  cache_simulator->victim_hits += result.victim_hit;
+
+  cache_simulator->accesses++;
+  if (intervals && intervals->length &&
+      cache_simulator->accesses - cache_simulator->interval_start ==
+          intervals->length)
+    end_interval(cache_simulator);
+}
+
+// fold the counters of a partial run (e.g. one worker) into total
+void merge_simulator_counts(cache_simulator_t *total,
+                            const cache_simulator_t *part) {
+  total->hits += part->hits;
+  total->misses += part->misses;
+  total->evictions += part->evictions;
+  total->dirty_evictions += part->dirty_evictions;
+  total->bytes_read += part->bytes_read;
+  total->bytes_written += part->bytes_written;
+  total->split_accesses += part->split_accesses;
+  total->split_blocks += part->split_blocks;
+  total->split_misses += part->split_misses;
+  total->victim_hits += part->victim_hits;
+}
+
+cache_simulator_t *construct_cache_simulator(size_t s, size_t b, size_t e,
+                                             const cache_options_t *options,
+                                             bool is_verbose) {
+  cache_simulator_t *cache_simulator =
+      checked_calloc(1, sizeof(cache_simulator_t));
+
+  cache_simulator->is_verbose = is_verbose;
+  cache_simulator->split_unaligned = options->split_unaligned;
+  cache_simulator->cache = construct_cache(s, b, e, options);
+  cache_simulator->first_set = 0;
+  cache_simulator->last_set = cache_simulator->cache->set_count;
+
+  return cache_simulator;
+}
+
+void break_down_cache_simulator(cache_simulator_t *cache_simulator) {
+  if (cache_simulator->attribution)
+    break_down_miss_attribution(cache_simulator->attribution);
+  if (cache_simulator->classifier)
+    break_down_miss_classifier(cache_simulator->classifier);
+  if (cache_simulator->prefetcher)
+    break_down_prefetcher(cache_simulator->prefetcher);
+  if (cache_simulator->latency)
+    break_down_latency_model(cache_simulator->latency);
+  if (cache_simulator->sampling)
+    break_down_sampling(cache_simulator->sampling);
+  if (cache_simulator->mshr)
+    break_down_mshr(cache_simulator->mshr);
+  if (cache_simulator->intervals)
+    free_block_map(&cache_simulator->interval_blocks);
+  break_down_cache(cache_simulator->cache);
+  free(cache_simulator);
+}
+
+// Stack distance section start
+
+/*
+For a fixed set count and block size LRU is a stack algorithm: an access hits
+in an E way cache exactly when fewer than E distinct blocks of its set were
+touched since its previous access. One pass recording that stack distance per
+access therefore yields the counts for every E at once.
+
+Each set keeps at most max_e live blocks stamped with a per-set clock. A
+Fenwick tree over the stamps counts how many live blocks are more recent than
+a given one in O(log E), and a block map takes a block to its stamp. When a
+set's clock runs off the end of its tree the set is compacted, renumbering
+the live blocks in order, which amortises to O(1) per access.
+*/
+
+#define NO_BLOCK ((size_t)-1)
+
+typedef struct stack_distance {
+  int s; // setIndexBits
+  int b; // blockBits
+  size_t set_mask;
+  size_t max_e;
+  size_t capacity; // stamps per set between compactions, 2 * max_e
+
+  unsigned int *fenwick; // [set_count * (capacity + 1)]
+  size_t *block_at;      // [set_count * capacity], NO_BLOCK when free
+  size_t *next_stamp;    // [set_count]
+  size_t *live;          // [set_count]
+  size_t *peak;          // [set_count], min(max_e, distinct blocks seen)
+
+  block_map_t stamps; // block -> stamp within its set
+
+  unsigned long long *histogram; // [max_e + 1], last bucket is >= max_e
+  unsigned long long modifies;
+  bool split_unaligned;
+} stack_distance_t;
+
+static inline void fenwick_add(unsigned int *tree, size_t capacity,
+                               size_t stamp, int delta) {
+  for (size_t i = stamp + 1; i <= capacity; i += i & -i)
+    tree[i] += delta;
+}
+
+// number of live stamps <= stamp
+static inline size_t fenwick_prefix(const unsigned int *tree, size_t stamp) {
+  size_t sum = 0;
+  for (size_t i = stamp + 1; i > 0; i -= i & -i)
+    sum += tree[i];
+  return sum;
+}
+
+// smallest live stamp, the set must not be empty
+static inline size_t fenwick_oldest(const unsigned int *tree,
+                                    size_t capacity) {
+  size_t position = 0;
+  size_t step = 1;
+  while (step * 2 <= capacity)
+    step *= 2;
+
+  for (; step > 0; step /= 2)
+    if (position + step <= capacity && tree[position + step] == 0)
+      position += step;
+
+  return position;
+}
+
+// rebuild tree over capacity stamps of which exactly [0, live) are set:
+// node i covers (i - lowbit(i), i]
+static void fenwick_fill(unsigned int *tree, size_t capacity, size_t live) {
+  for (size_t i = 1; i <= capacity; i++) {
+    size_t low = i - (i & -i);
+    size_t high = i < live ? i : live;
+    tree[i] = high > low ? high - low : 0;
+  }
+}
+
+stack_distance_t *construct_stack_distance(size_t s, size_t b, size_t max_e,
+                                           bool split_unaligned) {
+  stack_distance_t *sd = checked_calloc(1, sizeof(stack_distance_t));
+  size_t set_count = 1UL << s;
+
+  sd->s = s;
+  sd->b = b;
+  sd->set_mask = set_count - 1;
+  sd->max_e = max_e;
+  sd->capacity = 2 * max_e;
+  sd->split_unaligned = split_unaligned;
+
+  sd->fenwick = checked_calloc(set_count * (sd->capacity + 1),
+                               sizeof(unsigned int));
+  sd->block_at = checked_calloc(set_count * sd->capacity, sizeof(size_t));
+  for (size_t i = 0; i < set_count * sd->capacity; i++)
+    sd->block_at[i] = NO_BLOCK;
+  sd->next_stamp = checked_calloc(set_count, sizeof(size_t));
+  sd->live = checked_calloc(set_count, sizeof(size_t));
+  sd->peak = checked_calloc(set_count, sizeof(size_t));
+
+  init_block_map(&sd->stamps, 2 * set_count * max_e);
+
+  sd->histogram = checked_calloc(max_e + 1, sizeof(unsigned long long));
+  return sd;
+}
+
+void break_down_stack_distance(stack_distance_t *sd) {
+  free(sd->fenwick);
+  free(sd->block_at);
+  free(sd->next_stamp);
+  free(sd->live);
+  free(sd->peak);
+  free_block_map(&sd->stamps);
+  free(sd->histogram);
+  free(sd);
+}
+
+// renumber the live stamps of a set to 0..live-1 and rebuild its tree
+static void compact_set(stack_distance_t *sd, size_t set_index) {
+  size_t capacity = sd->capacity;
+  size_t *block_at = sd->block_at + set_index * capacity;
+  unsigned int *tree = sd->fenwick + set_index * (capacity + 1);
+  size_t live = 0;
+
+  for (size_t stamp = 0; stamp < capacity; stamp++) {
+    size_t block = block_at[stamp];
+    if (block == NO_BLOCK)
+      continue;
+    block_at[stamp] = NO_BLOCK;
+    block_at[live] = block;
+    sd->stamps.values[block_map_find(&sd->stamps, block)] = live;
+    live++;
+  }
+
+  fenwick_fill(tree, capacity, live);
+  sd->next_stamp[set_index] = live;
+}
+
+void record_stack_distance(stack_distance_t *sd, size_t address) {
+  size_t block = address >> sd->b;
+  size_t set_index = block & sd->set_mask;
+  size_t capacity = sd->capacity;
+  unsigned int *tree = sd->fenwick + set_index * (capacity + 1);
+  size_t *block_at = sd->block_at + set_index * capacity;
+
+  size_t slot = block_map_find(&sd->stamps, block);
+  if (block_map_used(&sd->stamps, slot)) {
+    size_t stamp = sd->stamps.values[slot];
+    // blocks used since this one are the live stamps after it
+    size_t distance = sd->live[set_index] - fenwick_prefix(tree, stamp);
+    sd->histogram[distance]++;
+
+    fenwick_add(tree, capacity, stamp, -1);
+    block_at[stamp] = NO_BLOCK;
+    sd->live[set_index]--;
+  } else {
+    sd->histogram[sd->max_e]++;
+
+    if (sd->live[set_index] == sd->max_e) {
+      // deeper than any simulated associativity, forget the oldest block
+      size_t oldest = fenwick_oldest(tree, capacity);
+      block_map_remove(&sd->stamps,
+                       block_map_find(&sd->stamps, block_at[oldest]));
+      fenwick_add(tree, capacity, oldest, -1);
+      block_at[oldest] = NO_BLOCK;
+      sd->live[set_index]--;
+    }
+  }
+
+  if (sd->next_stamp[set_index] == capacity)
+    compact_set(sd, set_index);
+
+  size_t stamp = sd->next_stamp[set_index]++;
+  fenwick_add(tree, capacity, stamp, 1);
+  block_at[stamp] = block;
+  block_map_put(&sd->stamps, block, stamp);
+
+  if (++sd->live[set_index] > sd->peak[set_index])
+    sd->peak[set_index] = sd->live[set_index];
+}
+
+void simulate_stack_distance(stack_distance_t *sd,
+                             const trace_record_t *record) {
+  if (record->operation == INSTRUCTION_LOAD)
+    return;
+
+  size_t blocks = sd->split_unaligned
+                      ? blocks_touched(record->address, record->size, sd->b)
+                      : 1;
+
+  for (size_t i = 0; i < blocks; i++) {
+    record_stack_distance(sd, record->address + (i << sd->b));
+    if (record->operation == MODIFY)
+      sd->modifies++;
+  }
+}
+
+// print the counts an E way cache would see, for every E up to max_e
+void print_miss_curve(const stack_distance_t *sd) {
+  unsigned long long accesses = 0;
+  for (size_t d = 0; d <= sd->max_e; d++)
+    accesses += sd->histogram[d];
+
+  unsigned long long hits = 0;
+  for (size_t e = 1; e <= sd->max_e; e++) {
+    hits += sd->histogram[e - 1];
+    unsigned long long misses = accesses - hits;
+
+    // a set only fills empty ways until it holds min(E, distinct) blocks
+    unsigned long long fills = 0;
+    for (size_t set = 0; set <= sd->set_mask; set++)
+      fills += sd->peak[set] < e ? sd->peak[set] : e;
+
+    printf("s:%d E:%zu b:%d hits:%llu misses:%llu evictions:%llu "
+           "miss_ratio:%.6f\n",
+           sd->s, e, sd->b, hits + sd->modifies, misses, misses - fills,
+           accesses ? (double)misses / accesses : 0.0);
+  }
+}
+
+// Stack distance section end
+
+// Reuse distance section start
+
+/*
+The reuse distance of an access is the number of distinct blocks touched
+since the previous access to its block, regardless of sets: a fully
+associative LRU cache of C blocks hits exactly the accesses with distance
+below C. As for stack distances, every block keeps the stamp of its last
+access and a Fenwick tree over the stamps counts the distinct blocks used
+after it, so each access costs O(log n). Nothing is forgotten here, so when
+the stamps run out the live ones are compacted and the tree doubles once
+they fill more than half of it.
+
+Windows of a fixed number of data accesses additionally report their
+working set, the distinct blocks each one touched.
+*/
+
+#define REUSE_BUCKETS 65 // distance 0, then [2^(k-1), 2^k) for k = 1..64
+
+typedef struct reuse_distance {
+  int b;
+  bool split_unaligned;
+
+  size_t capacity;
+  unsigned int *fenwick; // [capacity + 1]
+  size_t *block_at;      // [capacity], NO_BLOCK when free
+  size_t next_stamp;
+  size_t live; // distinct blocks so far
+  block_map_t stamps;
+
+  unsigned long long histogram[REUSE_BUCKETS];
+  unsigned long long cold; // first touches
+  unsigned long long references;
+
+  unsigned long long window_length; // 0 for no windows
+  unsigned long long window_accesses;
+  unsigned long long windows;
+  block_map_t window_blocks;
+} reuse_distance_t;
+
+static void allocate_reuse_stamps(reuse_distance_t *rd, size_t capacity) {
+  rd->capacity = capacity;
+  rd->fenwick = checked_calloc(capacity + 1, sizeof(unsigned int));
+  rd->block_at = checked_calloc(capacity, sizeof(size_t));
+  for (size_t i = 0; i < capacity; i++)
+    rd->block_at[i] = NO_BLOCK;
+}
+
+reuse_distance_t *construct_reuse_distance(size_t b,
+                                           unsigned long long window_length,
+                                           bool split_unaligned) {
+  reuse_distance_t *rd = checked_calloc(1, sizeof(reuse_distance_t));
+
+  rd->b = b;
+  rd->split_unaligned = split_unaligned;
+  rd->window_length = window_length;
+  allocate_reuse_stamps(rd, 1024);
+  init_block_map(&rd->stamps, 1024);
+  init_block_map(&rd->window_blocks, 1024);
+  return rd;
+}
+
+void break_down_reuse_distance(reuse_distance_t *rd) {
+  free(rd->fenwick);
+  free(rd->block_at);
+  free_block_map(&rd->stamps);
+  free_block_map(&rd->window_blocks);
+  free(rd);
+}
+
+// renumber the live stamps to 0..live-1, growing the tree if they crowd it
+static void compact_reuse_stamps(reuse_distance_t *rd) {
+  size_t *old_block_at = rd->block_at;
+  size_t old_capacity = rd->capacity;
+
+  free(rd->fenwick);
+  allocate_reuse_stamps(rd, rd->live > old_capacity / 2 ? 2 * old_capacity
+                                                        : old_capacity);
+
+  size_t live = 0;
+  for (size_t stamp = 0; stamp < old_capacity; stamp++) {
+    size_t block = old_block_at[stamp];
+    if (block == NO_BLOCK)
+      continue;
+    rd->block_at[live] = block;
+    rd->stamps.values[block_map_find(&rd->stamps, block)] = live;
+    live++;
+  }
+  free(old_block_at);
+
+  fenwick_fill(rd->fenwick, rd->capacity, live);
+  rd->next_stamp = live;
+}
+
+static inline int reuse_bucket(size_t distance) {
+  int bucket = 0;
+  while (distance) {
+    bucket++;
+    distance >>= 1;
+  }
+  return bucket;
+}
+
+void record_reuse_distance(reuse_distance_t *rd, size_t block) {
+  rd->references++;
+
+  size_t slot = block_map_find(&rd->stamps, block);
+  if (block_map_used(&rd->stamps, slot)) {
+    size_t stamp = rd->stamps.values[slot];
+    size_t distance = rd->live - fenwick_prefix(rd->fenwick, stamp);
+    rd->histogram[reuse_bucket(distance)]++;
+
+    fenwick_add(rd->fenwick, rd->capacity, stamp, -1);
+    rd->block_at[stamp] = NO_BLOCK;
+    rd->live--;
+  } else {
+    rd->cold++;
+  }
+
+  if (rd->next_stamp == rd->capacity)
+    compact_reuse_stamps(rd);
+
+  size_t stamp = rd->next_stamp++;
+  fenwick_add(rd->fenwick, rd->capacity, stamp, 1);
+  rd->block_at[stamp] = block;
+  block_map_put(&rd->stamps, block, stamp);
+  rd->live++;
+
+  if (rd->window_length)
+    block_map_put(&rd->window_blocks, block, 0);
+}
+
+static void end_reuse_window(reuse_distance_t *rd) {
+  printf("window:%llu accesses:%llu working_set:%zu\n", rd->windows,
+         rd->window_accesses, rd->window_blocks.count);
+  rd->windows++;
+  rd->window_accesses = 0;
+  clear_block_map(&rd->window_blocks);
+}
+
+void simulate_reuse_distance(reuse_distance_t *rd,
+                             const trace_record_t *record) {
+  if (record->operation == INSTRUCTION_LOAD)
+    return;
+
+  size_t blocks = rd->split_unaligned
+                      ? blocks_touched(record->address, record->size, rd->b)
+                      : 1;
+
+  for (size_t i = 0; i < blocks; i++) {
+    size_t block = (record->address >> rd->b) + i;
+    record_reuse_distance(rd, block);
+    // the store half of a modify reuses the block straight away
+    if (record->operation == MODIFY)
+      record_reuse_distance(rd, block);
+  }
+
+  if (rd->window_length && ++rd->window_accesses == rd->window_length)
+    end_reuse_window(rd);
+}
+
+void print_reuse_histogram(reuse_distance_t *rd) {
+  if (rd->window_accesses > 0)
+    end_reuse_window(rd);
+
+  printf("b:%d references:%llu blocks:%zu cold:%llu\n", rd->b,
+         rd->references, rd->live, rd->cold);
+  for (int k = 0; k < REUSE_BUCKETS; k++) {
+    if (!rd->histogram[k])
+      continue;
+    size_t low = k == 0 ? 0 : (size_t)1 << (k - 1);
+    size_t high = k == 0 ? 0 : (k == 64 ? SIZE_MAX : ((size_t)1 << k) - 1);
+    printf("distance:%zu-%zu count:%llu\n", low, high, rd->histogram[k]);
+  }
+}
+
+// Reuse distance section end
+
+// TLB section start
+
+/*
+A TLB is a set associative LRU cache of page numbers, so it is simulated
+with a cache_t whose blocks are pages. It sees the data accesses of the
+trace (an access straddling a page boundary looks up both pages) and
+charges each miss one page walk. A walk of the x86-64 four level page table
+reads one entry per level, and a 2 MB page stops a level early.
+*/
+
+#define PAGE_BITS_4K 12
+#define PAGE_BITS_2M 21
+#define PAGE_TABLE_LEVELS 4
+
+typedef struct tlb {
+  size_t entries;
+  size_t ways;
+  int page_bits;
+  bool split_unaligned;
+
+  unsigned long long hits;
+  unsigned long long misses;
+  unsigned long long walk_references; // page table entries read
+
+  cache_t *cache;
+} tlb_t;
+
+tlb_t *construct_tlb(size_t entries, size_t ways, int page_bits,
+                     bool split_unaligned) {
+  size_t set_count = ways > 0 && entries % ways == 0 ? entries / ways : 0;
+  int s = 0;
+  while ((1UL << s) < set_count)
+    s++;
+  if (set_count == 0 || (1UL << s) != set_count) {
+    fprintf(stderr, "TLB entries / ways must be a power of two\n");
+    exit(EXIT_FAILURE);
+  }
+
+  tlb_t *tlb = checked_calloc(1, sizeof(tlb_t));
+  cache_options_t options = {.policy = POLICY_LRU, .write_allocate = true};
+
+  tlb->entries = entries;
+  tlb->ways = ways;
+  tlb->page_bits = page_bits;
+  tlb->split_unaligned = split_unaligned;
+  tlb->cache = construct_cache(s, page_bits, ways, &options);
+  return tlb;
+}
+
+void break_down_tlb(tlb_t *tlb) {
+  break_down_cache(tlb->cache);
+  free(tlb);
+}
+
+void simulate_tlb(tlb_t *tlb, const trace_record_t *record) {
+  if (record->operation == INSTRUCTION_LOAD)
+    return;
+
+  size_t pages = tlb->split_unaligned ? blocks_touched(record->address,
+                                                       record->size,
+                                                       tlb->page_bits)
+                                      : 1;
+  int walk_levels =
+      PAGE_TABLE_LEVELS - (tlb->page_bits - PAGE_BITS_4K) / 9;
+
+  for (size_t i = 0; i < pages; i++) {
+    access_result_t result = {0};
+    size_t page = (record->address >> tlb->page_bits) + i;
+    execute_operation_in_cache(tlb->cache, DATA_LOAD,
+                               page << tlb->page_bits, 1, &result);
+
+    tlb->hits += result.hit;
+    tlb->misses += result.miss;
+    tlb->walk_references += result.miss * walk_levels;
+  }
+}
+
+void print_tlb_summary(const tlb_t *tlb) {
+  unsigned long long lookups = tlb->hits + tlb->misses;
+
+  printf("tlb entries:%zu ways:%zu page:%s hits:%llu misses:%llu "
+         "hit_rate:%.6f page_walks:%llu walk_references:%llu\n",
+         tlb->entries, tlb->ways,
+         tlb->page_bits == PAGE_BITS_2M ? "2m" : "4k", tlb->hits,
+         tlb->misses, lookups ? (double)tlb->hits / lookups : 0.0,
+         tlb->misses, tlb->walk_references);
+}
+
+// TLB section end
+
+// Hierarchy section start
+
+/*
+A hierarchy chains caches L1..Ln in front of memory. All levels share the
+block size and replacement policy, are write-back/write-allocate, and follow
+one inclusion policy:
+
+  inclusive  every block of a level is also in the levels below it, so a
+             block evicted from a lower level is back-invalidated above
+  exclusive  a block lives in one level only: demand fills go straight to L1
+             and each level's victims drop into the level below
+  nine       non-inclusive non-exclusive: a miss fills every level that
+             missed and nothing is back-invalidated
+
+Dirty victims are written into the next level (allocating there if needed)
+or to memory below the last level.
+*/
+
+typedef enum inclusion_policy {
+  INCLUSION_NINE = 0,
+  INCLUSION_INCLUSIVE = 1,
+  INCLUSION_EXCLUSIVE = 2,
+} inclusion_policy_t;
+
+static const char *inclusion_names[] = {
+    [INCLUSION_NINE] = "nine",
+    [INCLUSION_INCLUSIVE] = "inclusive",
+    [INCLUSION_EXCLUSIVE] = "exclusive",
+};
+
+typedef struct level_stats {
+  unsigned long long hits;
+  unsigned long long misses;
+  unsigned long long evictions;
+  unsigned long long writebacks;         // dirty victims sent down
+  unsigned long long back_invalidations; // inclusive only
+} level_stats_t;
+
+typedef struct cache_hierarchy {
+  inclusion_policy_t inclusion;
+  bool split_unaligned;
+  size_t level_count;
+  cache_t **levels;     // [level_count], L1 first
+  level_stats_t *stats; // [level_count]
+
+  unsigned long long memory_reads;  // blocks
+  unsigned long long memory_writes; // blocks
+
+  latency_model_t *latency; // NULL unless -y was given
+} cache_hierarchy_t;
+
+static void evict_from_level(cache_hierarchy_t *hierarchy, size_t level,
+                             size_t victim, bool dirty);
+
+// a dirty block written back from the level above
+static void write_back_to_level(cache_hierarchy_t *hierarchy, size_t level,
+                                size_t address) {
+  if (level == hierarchy->level_count) {
+    hierarchy->memory_writes++;
+    return;
+  }
+
+  if (lookup_block(hierarchy->levels[level], address, true))
+    return;
+
+  size_t victim;
+  bool victim_dirty;
+  if (fill_block(hierarchy->levels[level], address, true, &victim,
+                 &victim_dirty))
+    evict_from_level(hierarchy, level, victim, victim_dirty);
+}
+
+// exclusive: a victim of the level above, clean or dirty, moves down here
+static void insert_victim(cache_hierarchy_t *hierarchy, size_t level,
+                          size_t address, bool dirty) {
+  if (level == hierarchy->level_count) {
+    if (dirty)
+      hierarchy->memory_writes++;
+    return;
+  }
+
+  size_t victim;
+  bool victim_dirty;
+  if (fill_block(hierarchy->levels[level], address, dirty, &victim,
+                 &victim_dirty))
+    evict_from_level(hierarchy, level, victim, victim_dirty);
+}
+
+static void evict_from_level(cache_hierarchy_t *hierarchy, size_t level,
+                             size_t victim, bool dirty) {
+  hierarchy->stats[level].evictions++;
+
+  if (hierarchy->inclusion == INCLUSION_INCLUSIVE) {
+    for (size_t above = 0; above < level; above++) {
+      bool was_dirty;
+      if (invalidate_block(hierarchy->levels[above], victim, &was_dirty)) {
+        hierarchy->stats[above].back_invalidations++;
+        dirty = dirty || was_dirty;
+      }
+    }
+  }
+
+  if (dirty)
+    hierarchy->stats[level].writebacks++;
+
+  if (hierarchy->inclusion == INCLUSION_EXCLUSIVE)
+    insert_victim(hierarchy, level + 1, victim, dirty);
+  else if (dirty)
+    write_back_to_level(hierarchy, level + 1, victim);
+}
+
+// demand access arriving at level, returns the dirty bit of a block handed
+// up out of an exclusive level
+static bool fetch_block(cache_hierarchy_t *hierarchy, size_t level,
+                        size_t address, bool is_store) {
+  if (level == hierarchy->level_count) {
+    hierarchy->memory_reads++;
+    return false;
+  }
+
+  cache_t *cache = hierarchy->levels[level];
+  bool is_exclusive_lower =
+      hierarchy->inclusion == INCLUSION_EXCLUSIVE && level > 0;
+
+  if (lookup_block(cache, address, is_store)) {
+    hierarchy->stats[level].hits++;
+
+    bool dirty = false;
+    if (is_exclusive_lower)
+      invalidate_block(cache, address, &dirty);
+    return dirty;
+  }
+
+  hierarchy->stats[level].misses++;
+  bool dirty = fetch_block(hierarchy, level + 1, address, false);
+  if (is_exclusive_lower)
+    return dirty;
+
+  size_t victim;
+  bool victim_dirty;
+  if (fill_block(cache, address, dirty || is_store, &victim, &victim_dirty))
+    evict_from_level(hierarchy, level, victim, victim_dirty);
+  return false;
+}
+
+void simulate_hierarchy(cache_hierarchy_t *hierarchy,
+                        const trace_record_t *record) {
+  if (record->operation == INSTRUCTION_LOAD)
+    return;
+
+  int b = hierarchy->levels[0]->b;
+  size_t blocks = hierarchy->split_unaligned
+                      ? blocks_touched(record->address, record->size, b)
+                      : 1;
+
+  for (size_t i = 0; i < blocks; i++) {
+    // the access is served by the first level that did not miss
+    size_t served = 0;
+    for (size_t level = 0; level < hierarchy->level_count; level++)
+      served -= hierarchy->stats[level].misses;
+
+    fetch_block(hierarchy, 0, record->address + (i << b),
+                record->operation != DATA_LOAD);
+
+    for (size_t level = 0; level < hierarchy->level_count; level++)
+      served += hierarchy->stats[level].misses;
+    if (hierarchy->latency)
+      record_latency(hierarchy->latency, served);
+
+    // the store half of a modify always hits the line just loaded
+    if (record->operation == MODIFY) {
+      hierarchy->stats[0].hits++;
+      if (hierarchy->latency)
+        record_latency(hierarchy->latency, 0);
+    }
+  }
+}
+
+cache_hierarchy_t *construct_cache_hierarchy(const cache_config_t *configs,
+                                             size_t level_count,
+                                             inclusion_policy_t inclusion,
+                                             const cache_options_t *options) {
+  cache_hierarchy_t *hierarchy = checked_calloc(1, sizeof(cache_hierarchy_t));
+
+  hierarchy->inclusion = inclusion;
+  hierarchy->split_unaligned = options->split_unaligned;
+  hierarchy->level_count = level_count;
+  hierarchy->levels = checked_calloc(level_count, sizeof(cache_t *));
+  hierarchy->stats = checked_calloc(level_count, sizeof(level_stats_t));
+
+  for (size_t i = 0; i < level_count; i++) {
+    if (configs[i].b != configs[0].b) {
+      fprintf(stderr, "all hierarchy levels need the same block size\n");
+      exit(EXIT_FAILURE);
+    }
+    hierarchy->levels[i] =
+        construct_cache(configs[i].s, configs[i].b, configs[i].e, options);
+  }
+
+  return hierarchy;
+}
+
+void break_down_cache_hierarchy(cache_hierarchy_t *hierarchy) {
+  for (size_t i = 0; i < hierarchy->level_count; i++)
+    break_down_cache(hierarchy->levels[i]);
+  if (hierarchy->latency)
+    break_down_latency_model(hierarchy->latency);
+  free(hierarchy->levels);
+  free(hierarchy->stats);
+  free(hierarchy);
+}
+
+void print_hierarchy_summary(const cache_hierarchy_t *hierarchy) {
+  for (size_t i = 0; i < hierarchy->level_count; i++) {
+    const level_stats_t *stats = &hierarchy->stats[i];
+    printf("L%zu hits:%llu misses:%llu evictions:%llu writebacks:%llu "
+           "back_invalidations:%llu\n",
+           i + 1, stats->hits, stats->misses, stats->evictions,
+           stats->writebacks, stats->back_invalidations);
+  }
+
+  size_t block_size = 1UL << hierarchy->levels[0]->b;
+  printf("memory reads:%llu writes:%llu bytes_read:%llu bytes_written:%llu\n",
+         hierarchy->memory_reads, hierarchy->memory_writes,
+         hierarchy->memory_reads * block_size,
+         hierarchy->memory_writes * block_size);
+
+  if (hierarchy->latency)
+    print_latency_summary(hierarchy->latency, "");
+}
+
+// Hierarchy section end
+
+// Parallel section start
+
+/*
+Under LRU, sets never interact, so a trace can be replayed by several threads
+that each own a contiguous range of set indices. Every worker scans the whole
+decoded batch but only simulates the blocks that map into its range, using
+a private view of the shared cache: the line arrays are shared, while the LRU
+clock and the counters are the worker's own. Stamps are only ever compared
+within one set, so per-view clocks pick the same victims as the serial path,
+and the merged counters are identical to a serial run.
+
+The main thread is worker 0; while the others finish the current batch it
+decodes the next one into a second buffer.
+*/
+
+typedef struct parallel_simulation parallel_simulation_t;
+
+typedef struct simulation_worker {
+  pthread_t thread;
+  parallel_simulation_t *parallel;
+
+  cache_t *views;                // [config_count]
+  cache_simulator_t *simulators; // [config_count], one per view
+} simulation_worker_t;
+
+struct parallel_simulation {
+  size_t thread_count;
+  size_t config_count;
+  simulation_worker_t *workers;
+
+  pthread_barrier_t batch_ready;
+  pthread_barrier_t batch_done;
+  const trace_record_t *batch;
+  size_t count; // 0 tells the workers to exit
+};
+
+void replay_partition(simulation_worker_t *worker,
+                      const trace_record_t *batch, size_t count) {
+  // simulate_trace skips the blocks of sets this worker does not own
+  for (size_t c = 0; c < worker->parallel->config_count; c++)
+    for (size_t i = 0; i < count; i++)
+      simulate_trace(&worker->simulators[c], &batch[i]);
+}
+
+void *simulation_worker_main(void *arg) {
+  simulation_worker_t *worker = arg;
+  parallel_simulation_t *parallel = worker->parallel;
+
+  for (;;) {
+    pthread_barrier_wait(&parallel->batch_ready);
+    if (parallel->count == 0)
+      break;
+    replay_partition(worker, parallel->batch, parallel->count);
+    pthread_barrier_wait(&parallel->batch_done);
+  }
+
+  return NULL;
+}
+
+void simulate_trace_parallel(cache_simulator_t **simulators,
+                             size_t config_count, trace_reader_t *reader,
+                             size_t thread_count) {
+  parallel_simulation_t parallel = {.thread_count = thread_count,
+                                    .config_count = config_count};
+  parallel.workers = checked_calloc(thread_count, sizeof(simulation_worker_t));
+
+  for (size_t t = 0; t < thread_count; t++) {
+    simulation_worker_t *worker = &parallel.workers[t];
+    worker->parallel = &parallel;
+    worker->views = checked_calloc(config_count, sizeof(cache_t));
+    worker->simulators =
+        checked_calloc(config_count, sizeof(cache_simulator_t));
+
+    for (size_t c = 0; c < config_count; c++) {
+      cache_t *cache = simulators[c]->cache;
+      worker->views[c] = *cache;
+      worker->simulators[c].cache = &worker->views[c];
+      worker->simulators[c].split_unaligned = simulators[c]->split_unaligned;
+      worker->simulators[c].first_set = cache->set_count * t / thread_count;
+      worker->simulators[c].last_set =
+          cache->set_count * (t + 1) / thread_count;
+    }
+  }
+
+  pthread_barrier_init(&parallel.batch_ready, NULL, thread_count);
+  pthread_barrier_init(&parallel.batch_done, NULL, thread_count);
+  for (size_t t = 1; t < thread_count; t++) {
+    if (pthread_create(&parallel.workers[t].thread, NULL,
+                       simulation_worker_main, &parallel.workers[t]) != 0) {
+      perror("failed to start simulation worker");
+      exit(EXIT_FAILURE);
+    }
+  }
+
+  trace_record_t *batches[2];
+  batches[0] = checked_calloc(TRACE_BATCH_SIZE, sizeof(trace_record_t));
+  batches[1] = checked_calloc(TRACE_BATCH_SIZE, sizeof(trace_record_t));
+  int current = 0;
+  size_t count = read_trace_batch(reader, batches[current], TRACE_BATCH_SIZE);
+
+  while (count > 0) {
+    parallel.batch = batches[current];
+    parallel.count = count;
+    pthread_barrier_wait(&parallel.batch_ready);
+
+    replay_partition(&parallel.workers[0], batches[current], count);
+    current ^= 1;
+    count = read_trace_batch(reader, batches[current], TRACE_BATCH_SIZE);
+
+    pthread_barrier_wait(&parallel.batch_done);
+  }
+
+  parallel.count = 0;
+  pthread_barrier_wait(&parallel.batch_ready);
+
+  for (size_t t = 0; t < thread_count; t++) {
+    simulation_worker_t *worker = &parallel.workers[t];
+    if (t > 0)
+      pthread_join(worker->thread, NULL);
+
+    for (size_t c = 0; c < config_count; c++)
+      merge_simulator_counts(simulators[c], &worker->simulators[c]);
+
+    free(worker->views);
+    free(worker->simulators);
+  }
+
+  pthread_barrier_destroy(&parallel.batch_ready);
+  pthread_barrier_destroy(&parallel.batch_done);
+  free(batches[0]);
+  free(batches[1]);
+  free(parallel.workers);
+}
+
+// Parallel section end
+
+// Coherence section start
+
+/*
+Coherence simulation gives every core a private cache of the -s/-E/-b
+geometry and replays one trace per core, interleaved round robin one data
+access at a time. A directory maps each cached block to the set of cores
+holding it, and every line carries a MESI state (MOESI adds Owned: a
+modified line that another core reads is shared from the owner without
+a write-back).
+
+A write to a line other cores hold invalidates their copies. The core that
+lost a block remembers which bytes other cores have written to it since
+(one bit per 1/64 of the block). Its next miss on the block is a coherence
+miss, and if the access touches none of those bytes the invalidation
+carried no data it needed: a false sharing miss, charged to the block.
+*/
+
+#define MAX_CORES 64
+#define DEFAULT_HOTSPOTS 10
+
+typedef enum coherence_state {
+  STATE_INVALID = 0,
+  STATE_SHARED = 1,
+  STATE_EXCLUSIVE = 2,
+  STATE_OWNED = 3,
+  STATE_MODIFIED = 4,
+} coherence_state_t;
+
+typedef struct core {
+  trace_reader_t reader;
+  trace_record_t *batch;
+  size_t batch_count;
+  size_t batch_next;
+  bool done;
+
+  cache_t *cache;
+  unsigned char *state; // [set_count * line_count], coherence_state_t
+  block_map_t lost;     // block -> byte mask written since it was lost
+
+  unsigned long long hits;
+  unsigned long long misses;
+  unsigned long long evictions;
+  unsigned long long writebacks;
+  unsigned long long upgrades;      // writes to a shared line
+  unsigned long long invalidations; // copies taken away by other cores
+  unsigned long long coherence_misses;
+  unsigned long long false_sharing_misses;
+} core_t;
+
+typedef struct coherence {
+  bool moesi;
+  bool split_unaligned;
+  size_t core_count;
+  core_t *cores;
+
+  block_map_t directory;     // block -> mask of cores holding it
+  block_map_t false_sharing; // block -> false sharing misses
+  unsigned long long transfers; // blocks supplied by another core
+} coherence_t;
+
+// bits of the 64 slices of a block that size bytes at address touch
+static inline unsigned long long sharing_mask(int b, size_t address,
+                                              size_t size) {
+  int shift = b > 6 ? b - 6 : 0;
+  size_t offset = address & ((1UL << b) - 1);
+  size_t first = offset >> shift;
+  size_t last = (offset + (size ? size : 1) - 1) >> shift;
+  if (last > 63)
+    last = 63;
+
+  unsigned long long high = last == 63 ? ~0ULL : (2ULL << last) - 1;
+  return high & ~((1ULL << first) - 1);
+}
+
+static bool core_line(const core_t *core, size_t block, size_t *index) {
+  cache_t *cache = core->cache;
+  size_t set_index = block & cache->set_mask;
+  size_t line;
+
+  if (probe_set_for_memory(cache, set_index, block >> cache->s, &line) ==
+      PROBE_MISS)
+    return false;
+  *index = set_base(cache, set_index) + line;
+  return true;
+}
+
+static size_t *directory_entry(coherence_t *coherence, size_t block) {
+  size_t slot = block_map_find(&coherence->directory, block);
+  if (!block_map_used(&coherence->directory, slot)) {
+    block_map_put(&coherence->directory, block, 0);
+    slot = block_map_find(&coherence->directory, block);
+  }
+  return &coherence->directory.values[slot];
+}
+
+static void leave_directory(coherence_t *coherence, size_t block,
+                            size_t core) {
+  size_t slot = block_map_find(&coherence->directory, block);
+  if (!block_map_used(&coherence->directory, slot))
+    return;
+  coherence->directory.values[slot] &= ~(1UL << core);
+  if (coherence->directory.values[slot] == 0)
+    block_map_remove(&coherence->directory, slot);
+}
+
+static void invalidate_copy(coherence_t *coherence, size_t holder,
+                            size_t block) {
+  core_t *core = &coherence->cores[holder];
+  size_t index;
+
+  if (!core_line(core, block, &index))
+    return;
+  if (core->state[index] == STATE_MODIFIED ||
+      core->state[index] == STATE_OWNED)
+    coherence->transfers++; // the dirty data moves to the writer
+  core->state[index] = STATE_INVALID;
+  core->cache->tags[index] = INVALID_LINE;
+  core->invalidations++;
+  block_map_put(&core->lost, block, 0);
+}
+
+// tell every core that lost block which bytes were written to it
+static void note_write(coherence_t *coherence, size_t writer, size_t block,
+                       unsigned long long mask) {
+  for (size_t c = 0; c < coherence->core_count; c++) {
+    if (c == writer)
+      continue;
+    block_map_t *lost = &coherence->cores[c].lost;
+    size_t slot = block_map_find(lost, block);
+    if (block_map_used(lost, slot))
+      lost->values[slot] |= mask;
+  }
+}
+
+static void coherent_access(coherence_t *coherence, size_t id, bool is_write,
+                            size_t address, size_t size) {
+  core_t *core = &coherence->cores[id];
+  cache_t *cache = core->cache;
+  size_t block = address >> cache->b;
+  size_t set_index = block & cache->set_mask;
+  unsigned long long mask = sharing_mask(cache->b, address, size);
+  size_t index;
+
+  if (core_line(core, block, &index)) {
+    core->hits++;
+    touch_line(cache, set_index, index - set_base(cache, set_index), false);
+    if (!is_write)
+      return;
+
+    if (core->state[index] == STATE_SHARED ||
+        core->state[index] == STATE_OWNED) {
+      size_t others = *directory_entry(coherence, block) & ~(1UL << id);
+      for (size_t c = 0; c < coherence->core_count; c++)
+        if (others & (1UL << c))
+          invalidate_copy(coherence, c, block);
+      *directory_entry(coherence, block) = 1UL << id;
+      core->upgrades++;
+    }
+    core->state[index] = STATE_MODIFIED;
+    note_write(coherence, id, block, mask);
+    return;
+  }
+
+  core->misses++;
+  size_t slot = block_map_find(&core->lost, block);
+  if (block_map_used(&core->lost, slot)) {
+    core->coherence_misses++;
+    if (!(core->lost.values[slot] & mask)) {
+      core->false_sharing_misses++;
+      size_t hot = block_map_find(&coherence->false_sharing, block);
+      size_t count = block_map_used(&coherence->false_sharing, hot)
+                         ? coherence->false_sharing.values[hot]
+                         : 0;
+      block_map_put(&coherence->false_sharing, block, count + 1);
+    }
+    block_map_remove(&core->lost, slot);
+  }
+
+  size_t others = *directory_entry(coherence, block) & ~(1UL << id);
+  coherence_state_t state = is_write ? STATE_MODIFIED : STATE_EXCLUSIVE;
+  for (size_t c = 0; c < coherence->core_count; c++) {
+    if (!(others & (1UL << c)))
+      continue;
+    if (is_write) {
+      invalidate_copy(coherence, c, block);
+      continue;
+    }
+
+    core_t *holder = &coherence->cores[c];
+    size_t holder_index;
+    if (!core_line(holder, block, &holder_index))
+      continue;
+    if (holder->state[holder_index] == STATE_MODIFIED) {
+      if (coherence->moesi) {
+        holder->state[holder_index] = STATE_OWNED;
+      } else {
+        holder->state[holder_index] = STATE_SHARED;
+        holder->writebacks++;
+      }
+      coherence->transfers++;
+    } else if (holder->state[holder_index] == STATE_OWNED) {
+      coherence->transfers++;
+    } else if (holder->state[holder_index] == STATE_EXCLUSIVE) {
+      holder->state[holder_index] = STATE_SHARED;
+    }
+    state = STATE_SHARED;
+  }
+  if (is_write)
+    others = 0;
+
+  size_t line;
+  if (should_set_evict(cache, set_index, &line)) {
+    line = line_to_evict(cache, set_index);
+    size_t victim_index = set_base(cache, set_index) + line;
+    size_t victim = block_address(cache, set_index,
+                                  tag_of_line(cache, victim_index)) >>
+                    cache->b;
+    core->evictions++;
+    if (core->state[victim_index] == STATE_MODIFIED ||
+        core->state[victim_index] == STATE_OWNED)
+      core->writebacks++;
+    leave_directory(coherence, victim, id);
+  }
+
+  index = set_base(cache, set_index) + line;
+  cache->tags[index] = line_tag(block >> cache->s);
+  core->state[index] = state;
+  touch_line(cache, set_index, line, true);
+  *directory_entry(coherence, block) = others | (1UL << id);
+
+  if (is_write)
+    note_write(coherence, id, block, mask);
+}
+
+static void coherent_record(coherence_t *coherence, size_t id,
+                            const trace_record_t *record) {
+  int b = coherence->cores[id].cache->b;
+  size_t blocks = coherence->split_unaligned
+                      ? blocks_touched(record->address, record->size, b)
+                      : 1;
+  size_t block_size = 1UL << b;
+  size_t address = record->address;
+  size_t remaining = record->size;
+
+  for (size_t i = 0; i < blocks; i++) {
+    size_t block_end = (address | (block_size - 1)) + 1;
+    size_t chunk = i + 1 == blocks ? remaining : block_end - address;
+
+    if (record->operation != DATA_STORE)
+      coherent_access(coherence, id, false, address, chunk);
+    if (record->operation != DATA_LOAD)
+      coherent_access(coherence, id, true, address, chunk);
+
+    address = block_end;
+    remaining -= chunk;
+  }
+}
+
+// the next data access of a core, or NULL once its trace is done
+static const trace_record_t *next_core_record(core_t *core) {
+  while (!core->done) {
+    if (core->batch_next == core->batch_count) {
+      core->batch_count =
+          read_trace_batch(&core->reader, core->batch, TRACE_BATCH_SIZE);
+      core->batch_next = 0;
+      if (core->batch_count == 0) {
+        core->done = true;
+        break;
+      }
+    }
+
+    const trace_record_t *record = &core->batch[core->batch_next++];
+    if (record->operation != INSTRUCTION_LOAD)
+      return record;
+  }
+  return NULL;
+}
+
+coherence_t *construct_coherence(size_t s, size_t b, size_t e,
+                                 const cache_options_t *options, bool moesi,
+                                 char **trace_files,
+                                 const trace_format_t *formats,
+                                 size_t core_count) {
+  if (core_count > MAX_CORES) {
+    fprintf(stderr, "at most %d cores\n", MAX_CORES);
+    exit(EXIT_FAILURE);
+  }
+
+  coherence_t *coherence = checked_calloc(1, sizeof(coherence_t));
+  coherence->moesi = moesi;
+  coherence->split_unaligned = options->split_unaligned;
+  coherence->core_count = core_count;
+  coherence->cores = checked_calloc(core_count, sizeof(core_t));
+
+  for (size_t c = 0; c < core_count; c++) {
+    core_t *core = &coherence->cores[c];
+    open_trace_reader(&core->reader, trace_files[c], formats[c]);
+    core->batch = checked_calloc(TRACE_BATCH_SIZE, sizeof(trace_record_t));
+    core->cache = construct_cache(s, b, e, options);
+    core->state = checked_calloc(core->cache->set_count * e,
+                                 sizeof(unsigned char));
+    init_block_map(&core->lost, 1024);
+  }
+
+  init_block_map(&coherence->directory, 2 * core_count * (e << s));
+  init_block_map(&coherence->false_sharing, 1024);
+  return coherence;
+}
+
+void break_down_coherence(coherence_t *coherence) {
+  for (size_t c = 0; c < coherence->core_count; c++) {
+    core_t *core = &coherence->cores[c];
+    close_trace_reader(&core->reader);
+    free(core->batch);
+    break_down_cache(core->cache);
+    free(core->state);
+    free_block_map(&core->lost);
+  }
+  free(coherence->cores);
+  free_block_map(&coherence->directory);
+  free_block_map(&coherence->false_sharing);
+  free(coherence);
+}
+
+void simulate_coherence(coherence_t *coherence) {
+  bool progress = true;
+
+  while (progress) {
+    progress = false;
+    for (size_t c = 0; c < coherence->core_count; c++) {
+      const trace_record_t *record = next_core_record(&coherence->cores[c]);
+      if (record) {
+        coherent_record(coherence, c, record);
+        progress = true;
+      }
+    }
+  }
+}
+
+static int compare_hotspots(const void *a, const void *b) {
+  const size_t *x = a;
+  const size_t *y = b;
+  if (x[1] != y[1])
+    return x[1] < y[1] ? 1 : -1;
+  return x[0] < y[0] ? -1 : x[0] > y[0];
+}
+
+void print_coherence_summary(const coherence_t *coherence, size_t top_n) {
+  int b = coherence->cores[0].cache->b;
+
+  for (size_t c = 0; c < coherence->core_count; c++) {
+    const core_t *core = &coherence->cores[c];
+    printf("core:%zu hits:%llu misses:%llu evictions:%llu writebacks:%llu "
+           "upgrades:%llu invalidations:%llu coherence_misses:%llu "
+           "false_sharing_misses:%llu\n",
+           c, core->hits, core->misses, core->evictions, core->writebacks,
+           core->upgrades, core->invalidations, core->coherence_misses,
+           core->false_sharing_misses);
+  }
+  printf("protocol:%s transfers:%llu\n", coherence->moesi ? "moesi" : "mesi",
+         coherence->transfers);
+
+  // (block, misses) pairs, most false sharing first
+  const block_map_t *map = &coherence->false_sharing;
+  size_t *hotspots = checked_calloc(2 * map->count + 2, sizeof(size_t));
+  size_t count = 0;
+  for (size_t slot = 0; slot <= map->mask; slot++) {
+    if (!block_map_used(map, slot))
+      continue;
+    hotspots[2 * count] = map->keys[slot] - 1;
+    hotspots[2 * count + 1] = map->values[slot];
+    count++;
+  }
+  qsort(hotspots, count, 2 * sizeof(size_t), compare_hotspots);
+
+  size_t shown = count < top_n ? count : top_n;
+  printf("top %zu of %zu false sharing blocks\n", shown, count);
+  for (size_t i = 0; i < shown; i++)
+    printf("  block %zx misses:%zu\n", hotspots[2 * i] << b,
+           hotspots[2 * i + 1]);
+  free(hotspots);
+}
+
+// Coherence section end
+
+// Library section start
+
+/*
+The libcsim.h API, compiled into libcsim.a with -DCSIM_LIBRARY. A csim_t is
+a cache_simulator_t plus the options it was built from, so csim_reset can
+rebuild it; accesses go through simulate_trace exactly as trace records do.
+Unlike the command line, a bad configuration or a failed allocation is
+reported by returning NULL or -1 rather than exiting the host program.
+*/
+
+struct csim {
+  cache_config_t config;
+  cache_options_t options;
+  cache_simulator_t *simulator;
+};
+
+csim_config_t csim_default_config(void) {
+  csim_config_t config = {.s = 0,
+                          .e = 1,
+                          .b = 0,
+                          .policy = "lru",
+                          .write_back = true,
+                          .write_allocate = true,
+                          .split_unaligned = false,
+                          .seed = 1,
+                          .victim_entries = 0};
+  return config;
+}
+
+// construct_cache_simulator that returns NULL when out of memory
+static cache_simulator_t *build_simulator(const csim_t *sim) {
+  allocation_unwind_t unwind = {.count = 0};
+  cache_simulator_t *volatile simulator = NULL;
+
+  allocation_unwind = &unwind;
+  if (setjmp(unwind.target) == 0)
+    simulator = construct_cache_simulator(sim->config.s, sim->config.b,
+                                          sim->config.e, &sim->options, false);
+  allocation_unwind = NULL;
+  return simulator;
+}
+
+csim_t *csim_create(const csim_config_t *config) {
+  size_t count = sizeof(policy_names) / sizeof(policy_names[0]);
+  const char *policy = config->policy ? config->policy : "lru";
+  size_t e = config->e;
+
+  size_t index = 0;
+  while (index < count && strcmp(policy, policy_names[index]) != 0)
+    index++;
+  if (index == count || config_error(config->s, config->b, e, index))
+    return NULL;
+
+  csim_t *sim = malloc(sizeof(csim_t));
+  if (!sim)
+    return NULL;
+
+  sim->config = (cache_config_t){.s = config->s, .e = e, .b = config->b};
+  sim->options = (cache_options_t){.policy = index,
+                                   .seed = config->seed,
+                                   .write_allocate = config->write_allocate,
+                                   .write_through = !config->write_back,
+                                   .split_unaligned = config->split_unaligned,
+                                   .victim_entries = config->victim_entries};
+  sim->simulator = build_simulator(sim);
+  if (!sim->simulator) {
+    free(sim);
+    return NULL;
+  }
+  return sim;
+}
+
+void csim_destroy(csim_t *sim) {
+  if (!sim)
+    return;
+  break_down_cache_simulator(sim->simulator);
+  free(sim);
+}
+
+void csim_access(csim_t *sim, csim_kind_t kind, uint64_t address,
+                 uint32_t size) {
+  trace_record_t record = {
+      .address = address, .size = size, .operation = (operation_t)kind};
+  simulate_trace(sim->simulator, &record);
+}
+
+void csim_access_batch(csim_t *sim, csim_kind_t kind,
+                       const uint64_t *addresses, size_t count,
+                       uint32_t size) {
+  trace_record_t record = {.size = size, .operation = (operation_t)kind};
+  for (size_t i = 0; i < count; i++) {
+    record.address = addresses[i];
+    simulate_trace(sim->simulator, &record);
+  }
+}
+
+void csim_access_records(csim_t *sim, const csim_access_t *accesses,
+                         size_t count) {
+  for (size_t i = 0; i < count; i++) {
+    trace_record_t record = {.address = accesses[i].address,
+                             .size = accesses[i].size,
+                             .operation = (operation_t)accesses[i].kind};
+    simulate_trace(sim->simulator, &record);
+  }
+}
+
+void csim_get_stats(const csim_t *sim, csim_stats_t *stats) {
+  const cache_simulator_t *simulator = sim->simulator;
+  stats->hits = simulator->hits;
+  stats->misses = simulator->misses;
+  stats->evictions = simulator->evictions;
+  stats->dirty_evictions = simulator->dirty_evictions;
+  stats->bytes_read = simulator->bytes_read;
+  stats->bytes_written = simulator->bytes_written;
+  stats->victim_hits = simulator->victim_hits;
+}
+
+int csim_reset(csim_t *sim) {
+  cache_simulator_t *simulator = build_simulator(sim);
+  if (!simulator)
+    return -1;
+
+  break_down_cache_simulator(sim->simulator);
+  sim->simulator = simulator;
+  return 0;
+}
+
+void csim_reset_stats(csim_t *sim) {
+  cache_simulator_t *simulator = sim->simulator;
+  simulator->hits = 0;
+  simulator->misses = 0;
+  simulator->evictions = 0;
+  simulator->dirty_evictions = 0;
+  simulator->bytes_read = 0;
+  simulator->bytes_written = 0;
+  simulator->split_accesses = 0;
+  simulator->split_blocks = 0;
+  simulator->split_misses = 0;
+  simulator->victim_hits = 0;
+}
+
+// Library section end
+
+// Csim start
+
+void append_config(cache_config_t **configs, size_t *config_count,
+                   cache_config_t config) {
+  *configs = realloc(*configs, sizeof(cache_config_t) * (*config_count + 1));
+  if (!*configs) {
+    perror("config realloc failure");
+    exit(EXIT_FAILURE);
+  }
+  (*configs)[(*config_count)++] = config;
+}
+
+// parse a "-c s,E,b" argument, appending it to configs
+void add_config(cache_config_t **configs, size_t *config_count,
+                const char *arg) {
+  cache_config_t config;
+
+  if (sscanf(arg, "%zu,%zu,%zu", &config.s, &config.e, &config.b) != 3 ||
+      config.e == 0) {
+    fprintf(stderr, "bad configuration '%s', expected s,E,b\n", arg);
+    exit(EXIT_FAILURE);
+  }
+
+  append_config(configs, config_count, config);
+}
+
+// exit unless every configuration can be simulated under policy
+void check_configs(const cache_config_t *configs, size_t config_count,
+                   replacement_policy_t policy) {
+  for (size_t i = 0; i < config_count; i++) {
+    const cache_config_t *config = &configs[i];
+    const char *error = config_error(config->s, config->b, config->e, policy);
+    if (error) {
+      fprintf(stderr, "bad configuration s:%zu E:%zu b:%zu, %s\n", config->s,
+              config->e, config->b, error);
+      exit(EXIT_FAILURE);
+    }
+  }
+}
+
+// a decimal count such as -s, -E or -b, exiting on signs or trailing junk
+size_t parse_count(const char *arg, char option) {
+  char *end;
+  size_t value = strtoul(arg, &end, 10);
+  if (!isdigit((unsigned char)*arg) || *end != '\0') {
+    fprintf(stderr, "bad -%c '%s', expected a non-negative integer\n", option,
+            arg);
+    exit(EXIT_FAILURE);
+  }
+  return value;
+}
+
+replacement_policy_t parse_policy(const char *name) {
+  size_t count = sizeof(policy_names) / sizeof(policy_names[0]);
+
+  for (size_t i = 0; i < count; i++)
+    if (strcmp(name, policy_names[i]) == 0)
+      return i;
+
+  fprintf(stderr, "unknown replacement policy '%s'\n", name);
+  exit(EXIT_FAILURE);
+}
+
+// parse a "-f kind[,degree[,latency]]" argument
+void parse_prefetcher(const char *arg, prefetch_kind_t *kind, size_t *degree,
+                      unsigned long long *latency) {
+  size_t count = sizeof(prefetch_names) / sizeof(prefetch_names[0]);
+  size_t length = strcspn(arg, ",");
+
+  *kind = PREFETCH_NONE;
+  for (size_t i = 0; i < count; i++)
+    if (strlen(prefetch_names[i]) == length &&
+        strncmp(arg, prefetch_names[i], length) == 0)
+      *kind = i;
+
+  *degree = 1;
+  *latency = 0;
+  if (*kind == PREFETCH_NONE ||
+      (arg[length] &&
+       sscanf(arg + length, ",%zu,%llu", degree, latency) < 1) ||
+      *degree == 0) {
+    fprintf(stderr, "bad prefetcher '%s', expected "
+                    "next|stride|stream[,<degree>[,<latency>]]\n",
+            arg);
+    exit(EXIT_FAILURE);
+  }
+}
+
+// parse a "-L entries,ways[,4k|2m]" argument
+tlb_t *parse_tlb(const char *arg, bool split_unaligned) {
+  size_t entries, ways;
+  char page[4] = "4k";
+
+  int fields = sscanf(arg, "%zu,%zu,%3s", &entries, &ways, page);
+  if (fields < 2 || (strcmp(page, "4k") != 0 && strcmp(page, "2m") != 0)) {
+    fprintf(stderr, "bad TLB '%s', expected <entries>,<ways>[,4k|2m]\n",
+            arg);
+    exit(EXIT_FAILURE);
+  }
+
+  int page_bits = strcmp(page, "2m") == 0 ? PAGE_BITS_2M : PAGE_BITS_4K;
+  return construct_tlb(entries, ways, page_bits, split_unaligned);
+}
+
+inclusion_policy_t parse_inclusion(const char *name) {
+  size_t count = sizeof(inclusion_names) / sizeof(inclusion_names[0]);
+
+  for (size_t i = 0; i < count; i++)
+    if (strcmp(name, inclusion_names[i]) == 0)
+      return i;
+
+  fprintf(stderr, "unknown inclusion policy '%s'\n", name);
+  exit(EXIT_FAILURE);
+}
+
+// the options that pick a mode or add a model on top of the cache; exit
+// if one was given that the selected mode would silently ignore
+void check_mode_options(const bool *given, const char *mode,
+                        const char *supported) {
+  const char *features = "sEbWAprtTvxcjlIkKqSDfLgzMCRPGimFoyBwV";
+
+  for (const char *option = features; *option; option++)
+    if (given[(unsigned char)*option] && !strchr(supported, *option)) {
+      fprintf(stderr, "-%c is not supported with %s\n", *option, mode);
+      exit(EXIT_FAILURE);
+    }
+}
+
+// exit if an option that refines another was given without it; each entry
+// is the option then the options any one of which it needs
+void check_option_dependencies(const bool *given) {
+  static const char *const dependencies[] = {"PR", "GR", "Fim", "oim", "By",
+                                             "wy", "xu", "Il", "qkK"};
+  size_t count = sizeof(dependencies) / sizeof(dependencies[0]);
+
+  for (size_t i = 0; i < count; i++) {
+    const char *needed = dependencies[i] + 1;
+    if (!given[(unsigned char)dependencies[i][0]])
+      continue;
+
+    bool found = false;
+    for (const char *option = needed; *option; option++)
+      found |= given[(unsigned char)*option];
+    if (found)
+      continue;
+
+    fprintf(stderr, "-%c needs", dependencies[i][0]);
+    for (const char *option = needed; *option; option++)
+      fprintf(stderr, "%s -%c", option == needed ? "" : " or", *option);
+    fprintf(stderr, "\n");
+    exit(EXIT_FAILURE);
+  }
+}
+
+void run_hierarchy(const cache_config_t *levels, size_t level_count,
+                   inclusion_policy_t inclusion,
+                   const cache_options_t *options, trace_reader_t *reader,
+                   latency_model_t *latency) {
+  cache_hierarchy_t *hierarchy =
+      construct_cache_hierarchy(levels, level_count, inclusion, options);
+  hierarchy->latency = latency;
+
+  trace_record_t *batch =
+      checked_calloc(TRACE_BATCH_SIZE, sizeof(trace_record_t));
+  size_t count;
+  while ((count = read_trace_batch(reader, batch, TRACE_BATCH_SIZE)) > 0)
+    for (size_t i = 0; i < count; i++)
+      simulate_hierarchy(hierarchy, &batch[i]);
+
+  free(batch);
+  print_hierarchy_summary(hierarchy);
+  break_down_cache_hierarchy(hierarchy);
+}
+
+// libcsim.a is this file without main
+#ifndef CSIM_LIBRARY
+
+int main(int argc, char *argv[]) {
+  size_t s = 0, b = 0, e = 1;
+  bool has_geometry = false; // any of -s/-E/-b given
+  bool is_verbose = false;
+  char *trace_file = NULL;
+  trace_format_t trace_format = TRACE_TEXT;
+  cache_config_t *configs = NULL;
+  size_t config_count = 0;
+  size_t thread_count = 1;
+  size_t stack_max_e = 0;
+  bool reuse_distances = false;
+  unsigned long long reuse_window = 0;
+  interval_log_t interval_log = {.format = INTERVAL_TEXT};
+  char *interval_file = NULL;
+  cache_options_t options = {.policy = POLICY_LRU,
+                             .seed = 1,
+                             .write_allocate = true,
+                             .write_through = false,
+                             .split_unaligned = false};
+  bool show_split = false;
+  bool classify_misses = false;
+  char **tlb_args = NULL; // -L, parsed once -u is known
+  size_t tlb_count = 0;
+  char **core_files = NULL; // -k/-K, one trace per core
+  trace_format_t *core_formats = NULL;
+  size_t core_count = 0;
+  bool moesi = false;
+  char *latencies = NULL; // -y, one per level plus memory
+  double bytes_per_cycle = 0;
+  size_t set_period = 0;
+  size_t mshr_entries = 0;
+  unsigned long long mshr_window = 0;
+  unsigned long long sample_period = 0, sample_detail = 0, sample_warmup = 0;
+  unsigned long long mlp_window = 1;
+  prefetch_kind_t prefetch_kind = PREFETCH_NONE;
+  size_t prefetch_degree = 1;
+  unsigned long long prefetch_latency = 0;
+  size_t attribution_top_n = 0;
+  int page_bits = DEFAULT_PAGE_BITS;
+  address_range_t *ranges = NULL;
+  size_t range_count = 0;
+  cache_config_t *levels = NULL; // L2.. below the -s/-E/-b cache
+  size_t level_count = 0;
+  inclusion_policy_t inclusion = INCLUSION_NINE;
+
+  const char *optstring =
+      "s:E:b:vt:T:c:j:S:D:p:r:l:I:W:A:uxR:P:G:Ci:m:F:o:f:L:k:K:q:y:B:w:g:z:"
+      "V:M:";
+  bool given[128] = {false};
+  int opt;
+  while ((opt = getopt(argc, argv, optstring)) != -1) {
+    given[opt & 127] = true;
+    switch (opt) {
+    case 's':
+      s = parse_count(optarg, 's');
+      has_geometry = true;
+      break;
+    case 'E':
+      e = parse_count(optarg, 'E');
+      has_geometry = true;
+      break;
+    case 'b':
+      b = parse_count(optarg, 'b');
+      has_geometry = true;
+      break;
+    case 'v':
+      is_verbose = true;
+      break;
+    case 't':
+      trace_file = optarg;
+      trace_format = TRACE_TEXT;
+      break;
+    case 'T': // binary trace written by trace2bin
+      trace_file = optarg;
+      trace_format = TRACE_BINARY;
+      break;
+    case 'c': // extra geometry simulated in the same pass, may be repeated
+      add_config(&configs, &config_count, optarg);
+      break;
+    case 'S': // miss curve for E = 1..<max E> from stack distances
+      stack_max_e = atoi(optarg);
+      break;
+    case 'D': // reuse distance histogram, working set per <window> accesses
+      reuse_window = strtoull(optarg, NULL, 0);
+      reuse_distances = true;
+      break;
+    case 'l': // next lower cache level, may be repeated
+      add_config(&levels, &level_count, optarg);
+      break;
+    case 'I':
+      inclusion = parse_inclusion(optarg);
+      break;
+    case 'i': // per-interval counts every <N> data accesses
+      interval_log.length = strtoull(optarg, NULL, 0);
+      break;
+    case 'm': // tracegen's .marker file, intervals also end at markers
+      read_marker_file(&interval_log, optarg);
+      break;
+    case 'F':
+      interval_log.format = parse_interval_format(optarg);
+      break;
+    case 'o': // interval records go here instead of stdout
+      interval_file = optarg;
+      break;
+    case 'k': // one core's text trace, may be repeated
+    case 'K': // one core's binary trace
+      core_files = realloc(core_files, sizeof(char *) * (core_count + 1));
+      core_formats =
+          realloc(core_formats, sizeof(trace_format_t) * (core_count + 1));
+      if (!core_files || !core_formats) {
+        perror("core realloc failure");
+        exit(EXIT_FAILURE);
+      }
+      core_files[core_count] = optarg;
+      core_formats[core_count] = opt == 'K' ? TRACE_BINARY : TRACE_TEXT;
+      core_count++;
+      break;
+    case 'q':
+      if (strcmp(optarg, "mesi") != 0 && strcmp(optarg, "moesi") != 0) {
+        fprintf(stderr, "unknown coherence protocol '%s'\n", optarg);
+        exit(EXIT_FAILURE);
+      }
+      moesi = strcmp(optarg, "moesi") == 0;
+      break;
+    case 'y': // latency model: <L1>[,<L2>...],<memory> cycles
+      latencies = optarg;
+      break;
+    case 'B': // memory bandwidth in bytes per cycle
+      bytes_per_cycle = atof(optarg);
+      break;
+    case 'w': // accesses over which misses overlap
+      mlp_window = strtoull(optarg, NULL, 0);
+      break;
+    case 'V': // fully associative victim cache of <N> blocks per cache
+      options.victim_entries = atoi(optarg);
+      break;
+    case 'M': // <entries>,<window> miss status holding registers
+      if (sscanf(optarg, "%zu,%llu", &mshr_entries, &mshr_window) != 2) {
+        fprintf(stderr, "bad MSHRs '%s', expected <entries>,<window>\n",
+                optarg);
+        exit(EXIT_FAILURE);
+      }
+      break;
+    case 'g': // set sampling: simulate every <N>th set only
+      set_period = atoi(optarg);
+      if (set_period == 0) {
+        fprintf(stderr, "set sampling period must be positive\n");
+        exit(EXIT_FAILURE);
+      }
+      break;
+    case 'z': // time sampling: <period>,<detail>[,<warmup>]
+      if (sscanf(optarg, "%llu,%llu,%llu", &sample_period, &sample_detail,
+                 &sample_warmup) < 2 ||
+          sample_period == 0 || sample_detail == 0) {
+        fprintf(stderr, "bad time sampling '%s', expected "
+                        "<period>,<detail>[,<warmup>]\n",
+                optarg);
+        exit(EXIT_FAILURE);
+      }
+      break;
+    case 'L': // data TLB simulated alongside, may be repeated
+      tlb_args = realloc(tlb_args, sizeof(char *) * (tlb_count + 1));
+      if (!tlb_args) {
+        perror("tlb realloc failure");
+        exit(EXIT_FAILURE);
+      }
+      tlb_args[tlb_count++] = optarg;
+      break;
+    case 'f': // prefetcher model
+      parse_prefetcher(optarg, &prefetch_kind, &prefetch_degree,
+                       &prefetch_latency);
+      break;
+    case 'C': // compulsory/capacity/conflict breakdown
+      classify_misses = true;
+      break;
+    case 'R': // top-N miss attribution report
+      attribution_top_n = atoi(optarg);
+      break;
+    case 'P':
+      page_bits = atoi(optarg);
+      break;
+    case 'G': // explicit attribution region <start>-<end>, may be repeated
+      ranges = realloc(ranges, sizeof(address_range_t) * (range_count + 1));
+      if (!ranges ||
+          sscanf(optarg, "%zx-%zx", &ranges[range_count].start,
+                 &ranges[range_count].end) != 2) {
+        fprintf(stderr, "bad region '%s', expected <start>-<end> in hex\n",
+                optarg);
+        exit(EXIT_FAILURE);
+      }
+      range_count++;
+      break;
+    case 'u': // split each access over every block it touches
+      options.split_unaligned = true;
+      break;
+    case 'x':
+      show_split = true;
+      break;
+    case 'W':
+      if (strcmp(optarg, "back") != 0 && strcmp(optarg, "through") != 0) {
+        fprintf(stderr, "unknown write policy '%s'\n", optarg);
+        exit(EXIT_FAILURE);
+      }
+      options.write_through = strcmp(optarg, "through") == 0;
+      break;
+    case 'A':
+      if (strcmp(optarg, "allocate") != 0 && strcmp(optarg, "none") != 0) {
+        fprintf(stderr, "unknown write miss policy '%s'\n", optarg);
+        exit(EXIT_FAILURE);
+      }
+      options.write_allocate = strcmp(optarg, "allocate") == 0;
+      break;
+    case 'p':
+      options.policy = parse_policy(optarg);
+      break;
+    case 'r':
+      options.seed = strtoull(optarg, NULL, 0);
+      break;
+    case 'j': // worker threads, each owning a range of sets
+      thread_count = atoi(optarg);
+      if (thread_count == 0)
+        thread_count = 1;
+      break;
+    default:
+      fprintf(stderr,
+              "Usage: %s -s <s> -E <E> -b <b> (-t <tracefile> | -T <binfile>) "
+              "[-v] [-c <s>,<E>,<b>]... [-j <threads>] [-S <max E>]\n"
+              "       [-D <window>] "
+              "[-f next|stride|stream[,<degree>[,<latency>]]]\n"
+              "       [-L <entries>,<ways>[,4k|2m]]...\n"
+              "       [(-k <core trace> | -K <core binfile>)... "
+              "[-q mesi|moesi]]\n"
+              "       [-y <L1>[,<L2>...],<memory> [-B <bytes/cycle>] "
+              "[-w <window>]]\n"
+              "       [-g <set period>] [-z <period>,<detail>[,<warmup>]]\n"
+              "       [-V <victim entries>] [-M <entries>,<window>]\n"
+              "       [-i <interval>] [-m <marker file>] "
+              "[-F text|csv|binary] [-o <interval file>]\n"
+              "       [-p lru|fifo|random|plru|srrip|brrip|lfu] [-r <seed>]\n"
+              "       [-l <s>,<E>,<b>]... [-I nine|inclusive|exclusive]\n"
+              "       [-W back|through] [-A allocate|none] [-u [-x]] [-C]\n"
+              "       [-R <top N> [-P <page bits>] [-G <start>-<end>]...]\n",
+              argv[0]);
+      exit(EXIT_FAILURE);
+    }
+  }
+
+  check_option_dependencies(given);
+  // the seed drives the random and BRRIP policies and set sampling only
+  if (given['r'] && options.policy != POLICY_RANDOM &&
+      options.policy != POLICY_BRRIP && set_period == 0) {
+    fprintf(stderr, "-r needs -p random, -p brrip or -g\n");
+    exit(EXIT_FAILURE);
+  }
+
+  // every cache below is built from these, whatever the mode
+  cache_config_t geometry = {.s = s, .e = e, .b = b};
+  check_configs(&geometry, 1, options.policy);
+  check_configs(configs, config_count, options.policy);
+  check_configs(levels, level_count, options.policy);
+
+  if (stack_max_e > 0) {
+    check_mode_options(given, "-S", "tTSsbp");
+    if (options.policy != POLICY_LRU) {
+      fprintf(stderr, "-S only models LRU\n");
+      exit(EXIT_FAILURE);
+    }
+    stack_distance_t *sd = construct_stack_distance(s, b, stack_max_e,
+                                                    options.split_unaligned);
+    trace_reader_t reader;
+    open_trace_reader(&reader, trace_file, trace_format);
+
+    trace_record_t *batch =
+        checked_calloc(TRACE_BATCH_SIZE, sizeof(trace_record_t));
+    size_t count;
+    while ((count = read_trace_batch(&reader, batch, TRACE_BATCH_SIZE)) > 0)
+      for (size_t i = 0; i < count; i++)
+        simulate_stack_distance(sd, &batch[i]);
+
+    free(batch);
+    close_trace_reader(&reader);
+    print_miss_curve(sd);
+    break_down_stack_distance(sd);
+    free(configs);
+    return 0;
+  }
+
+  if (reuse_distances) {
+    check_mode_options(given, "-D", "tTDb");
+    reuse_distance_t *rd = construct_reuse_distance(b, reuse_window,
+                                                    options.split_unaligned);
+    trace_reader_t reader;
+    open_trace_reader(&reader, trace_file, trace_format);
+
+    trace_record_t *batch =
+        checked_calloc(TRACE_BATCH_SIZE, sizeof(trace_record_t));
+    size_t count;
+    while ((count = read_trace_batch(&reader, batch, TRACE_BATCH_SIZE)) > 0)
+      for (size_t i = 0; i < count; i++)
+        simulate_reuse_distance(rd, &batch[i]);
+
+    free(batch);
+    close_trace_reader(&reader);
+    print_reuse_histogram(rd);
+    break_down_reuse_distance(rd);
+    free(configs);
+    return 0;
+  }
+
+  if (core_count > 0) {
+    check_mode_options(given, "-k/-K", "kKqRsEbWApr");
+    if (!options.write_allocate || options.write_through) {
+      fprintf(stderr, "coherent caches are write-back/write-allocate\n");
+      exit(EXIT_FAILURE);
+    }
+    coherence_t *coherence = construct_coherence(
+        s, b, e, &options, moesi, core_files, core_formats, core_count);
+    simulate_coherence(coherence);
+    print_coherence_summary(coherence, attribution_top_n > 0
+                                           ? attribution_top_n
+                                           : DEFAULT_HOTSPOTS);
+    break_down_coherence(coherence);
+    free(core_files);
+    free(core_formats);
+    free(configs);
+    return 0;
+  }
+
+  // -s/-E/-b name one more configuration, reported first
+  if (has_geometry || config_count == 0) {
+    cache_config_t config = {.s = s, .e = e, .b = b};
+    append_config(&configs, &config_count, config);
+    memmove(&configs[1], &configs[0],
+            sizeof(cache_config_t) * (config_count - 1));
+    configs[0] = config;
+  }
+
+  if (level_count > 0) {
+    check_mode_options(given, "-l", "tTlIyBwsEbWApr");
+    if (!options.write_allocate || options.write_through) {
+      fprintf(stderr, "hierarchy levels are write-back/write-allocate\n");
+      exit(EXIT_FAILURE);
+    }
+    // the -s/-E/-b cache is L1
+    cache_config_t *hierarchy_levels =
+        checked_calloc(1 + level_count, sizeof(cache_config_t));
+    hierarchy_levels[0] = configs[0];
+    memcpy(&hierarchy_levels[1], levels, sizeof(cache_config_t) * level_count);
+
+    trace_reader_t reader;
+    open_trace_reader(&reader, trace_file, trace_format);
+    latency_model_t *latency =
+        latencies ? construct_latency_model(latencies, 1 + level_count,
+                                            configs[0].b, bytes_per_cycle,
+                                            mlp_window)
+                  : NULL;
+    run_hierarchy(hierarchy_levels, 1 + level_count, inclusion, &options,
+                  &reader, latency);
+    close_trace_reader(&reader);
+    free(hierarchy_levels);
+    free(configs);
+    free(levels);
+    return 0;
+  }
+
+  check_mode_options(given, "-s/-E/-b and -c caches",
+                     "sEbWAprtTvxcjfLgzMCRPGimFoyBwV");
+
+  // verbose output, attribution, intervals, prefetches, TLBs, miss overlap,
+  // sampling, victim caches, MSHRs and the shadow caches of the classifier
+  // follow trace order across all sets, so they only run serially
+  if (thread_count > 1)
+    check_mode_options(given, "-j above 1", "sEbWAprtTxcj");
+
+  if (is_verbose)
+    printf("Debug mode: %d\n", is_verbose);
+
+  cache_simulator_t **simulators =
+      checked_calloc(config_count, sizeof(cache_simulator_t *));
+  for (size_t i = 0; i < config_count; i++)
+    simulators[i] = construct_cache_simulator(
+        configs[i].s, configs[i].b, configs[i].e, &options, is_verbose);
+
+  trace_reader_t reader;
+  open_trace_reader(&reader, trace_file, trace_format);
+
+  // the first configuration is the one attributed
+  if (attribution_top_n > 0)
+    simulators[0]->attribution = construct_miss_attribution(
+        attribution_top_n, page_bits, ranges, range_count);
+
+  bool log_intervals = interval_log.length > 0 || interval_log.has_markers;
+  if (log_intervals) {
+    if (interval_log.format == INTERVAL_BINARY && !interval_file) {
+      fprintf(stderr, "binary intervals need an -o file\n");
+      exit(EXIT_FAILURE);
+    }
+    open_interval_log(&interval_log, interval_file);
+    for (size_t c = 0; c < config_count; c++) {
+      simulators[c]->intervals = &interval_log;
+      init_block_map(&simulators[c]->interval_blocks, 1024);
+    }
+  }
+
+  if (mshr_entries > 0)
+    for (size_t c = 0; c < config_count; c++)
+      simulators[c]->mshr = construct_mshr(mshr_entries, mshr_window);
+
+  if (set_period > 0 || sample_period > 0)
+    for (size_t c = 0; c < config_count; c++)
+      simulators[c]->sampling = construct_sampling(
+          set_period, sample_period, sample_detail, sample_warmup,
+          simulators[c]->cache->set_count, options.seed);
+
+  if (latencies)
+    for (size_t c = 0; c < config_count; c++)
+      simulators[c]->latency = construct_latency_model(
+          latencies, 1, configs[c].b, bytes_per_cycle, mlp_window);
+
+  if (prefetch_kind != PREFETCH_NONE)
+    for (size_t c = 0; c < config_count; c++)
+      simulators[c]->prefetcher = construct_prefetcher(
+          prefetch_kind, prefetch_degree, prefetch_latency,
+          simulators[c]->cache->set_count * simulators[c]->cache->line_count);
+
+  if (classify_misses)
+    for (size_t c = 0; c < config_count; c++)
+      simulators[c]->classifier = construct_miss_classifier(
+          simulators[c]->cache->set_count * simulators[c]->cache->line_count);
+
+  tlb_t **tlbs = checked_calloc(tlb_count + 1, sizeof(tlb_t *));
+  for (size_t t = 0; t < tlb_count; t++)
+    tlbs[t] = parse_tlb(tlb_args[t], options.split_unaligned);
+
+  if (thread_count > 1) {
+    simulate_trace_parallel(simulators, config_count, &reader, thread_count);
+  } else {
+    trace_record_t *batch =
+        checked_calloc(TRACE_BATCH_SIZE, sizeof(trace_record_t));
+    size_t count;
+
+    // every simulator replays the whole batch before the next one runs, so
+    // each cache's arrays stay hot while the decoded batch is reused
+    while ((count = read_trace_batch(&reader, batch, TRACE_BATCH_SIZE)) > 0) {
+      for (size_t c = 0; c < config_count; c++)
+        for (size_t i = 0; i < count; i++)
+          simulate_trace(simulators[c], &batch[i]);
+      for (size_t t = 0; t < tlb_count; t++)
+        for (size_t i = 0; i < count; i++)
+          simulate_tlb(tlbs[t], &batch[i]);
+    }
+
+    free(batch);
+  }
+
+  close_trace_reader(&reader);
+
+  // the last, partial interval
+  if (log_intervals) {
+    for (size_t c = 0; c < config_count; c++)
+      if (simulators[c]->accesses > simulators[c]->interval_start)
+        end_interval(simulators[c]);
+    close_interval_log(&interval_log);
+  }
+
+  if (config_count == 1) {
+    printSummary(simulators[0]->hits, simulators[0]->misses,
+                 simulators[0]->evictions);
+    // only on request, so a plain run prints exactly what csim-ref does
+    if (given['W'] || given['A'])
+      printf("dirty_evictions:%llu bytes_read:%llu bytes_written:%llu\n",
+             simulators[0]->dirty_evictions, simulators[0]->bytes_read,
+             simulators[0]->bytes_written);
+  } else {
+    for (size_t c = 0; c < config_count; c++)
+      printf("s:%zu E:%zu b:%zu hits:%llu misses:%llu evictions:%llu "
+             "dirty_evictions:%llu bytes_read:%llu bytes_written:%llu\n",
+             configs[c].s, configs[c].e, configs[c].b, simulators[c]->hits,
+             simulators[c]->misses, simulators[c]->evictions,
+             simulators[c]->dirty_evictions, simulators[c]->bytes_read,
+             simulators[c]->bytes_written);
+  }
+
+  if (show_split)
+    for (size_t c = 0; c < config_count; c++)
+      printf("s:%zu E:%zu b:%zu split_accesses:%llu split_blocks:%llu "
+             "split_misses:%llu\n",
+             configs[c].s, configs[c].e, configs[c].b,
+             simulators[c]->split_accesses, simulators[c]->split_blocks,
+             simulators[c]->split_misses);
+
+  if (prefetch_kind != PREFETCH_NONE)
+    for (size_t c = 0; c < config_count; c++)
+      printf("s:%zu E:%zu b:%zu prefetches:%llu useful:%llu late:%llu "
+             "useless:%llu polluting:%llu\n",
+             configs[c].s, configs[c].e, configs[c].b,
+             simulators[c]->prefetcher->issued,
+             simulators[c]->prefetcher->useful,
+             simulators[c]->prefetcher->late,
+             simulators[c]->prefetcher->useless,
+             simulators[c]->prefetcher->polluting);
+
+  if (classify_misses)
+    for (size_t c = 0; c < config_count; c++)
+      printf("s:%zu E:%zu b:%zu compulsory:%llu capacity:%llu conflict:%llu\n",
+             configs[c].s, configs[c].e, configs[c].b,
+             simulators[c]->classifier->compulsory,
+             simulators[c]->classifier->capacity,
+             simulators[c]->classifier->conflict);
+
+  for (size_t c = 0; c < config_count; c++) {
+    char prefix[80] = "";
+    if (config_count > 1)
+      snprintf(prefix, sizeof(prefix), "s:%zu E:%zu b:%zu ", configs[c].s,
+               configs[c].e, configs[c].b);
+    if (options.victim_entries > 0)
+      printf("%svictim_hits:%llu\n", prefix, simulators[c]->victim_hits);
+    if (simulators[c]->mshr)
+      printf("%smshr_allocations:%llu merged:%llu full_stalls:%llu\n",
+             prefix, simulators[c]->mshr->allocations,
+             simulators[c]->mshr->merged, simulators[c]->mshr->full_stalls);
+    if (simulators[c]->latency)
+      print_latency_summary(simulators[c]->latency, prefix);
+    if (simulators[c]->sampling)
+      print_sampling_summary(simulators[c]->sampling,
+                             simulators[c]->cache->set_count, prefix);
+  }
+
+  for (size_t t = 0; t < tlb_count; t++) {
+    print_tlb_summary(tlbs[t]);
+    break_down_tlb(tlbs[t]);
+  }
+  free(tlbs);
+  free(tlb_args);
+
+  if (simulators[0]->attribution)
+    print_miss_attribution(simulators[0]->attribution);
+
+  for (size_t c = 0; c < config_count; c++)
+    break_down_cache_simulator(simulators[c]);
+  free(simulators);
+  free(configs);
+  free(ranges);
+  return 0;
+}
+
+#endif /* CSIM_LIBRARY */
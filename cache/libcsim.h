@@ -0,0 +1,102 @@
+/*
+ * libcsim.h - Run the csim cache model in-process
+ *
+ * libcsim.a is csim.c built with -DCSIM_LIBRARY: the same cache engine the
+ * command line tool uses, without main. A program (or a test harness, or a
+ * tracing shim) creates a simulator, feeds it accesses one at a time or as
+ * arrays of addresses, and reads the counters back whenever it likes, with
+ * no trace file in between.
+ *
+ *   csim_config_t config = csim_default_config();
+ *   config.s = 6, config.e = 8, config.b = 6;
+ *   csim_t *sim = csim_create(&config);
+ *   csim_access_batch(sim, CSIM_LOAD, addresses, count, 8);
+ *   csim_stats_t stats;
+ *   csim_get_stats(sim, &stats);
+ *   csim_destroy(sim);
+ *
+ * A simulator is not thread safe; use one per thread. libcsim.a exports
+ * only the csim_ functions below; link it with -lm -pthread.
+ */
+
+#ifndef LIBCSIM_H
+#define LIBCSIM_H
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+typedef struct csim csim_t;
+
+// same values as the trace operations, a modify is a load then a store
+typedef enum csim_kind {
+  CSIM_LOAD = 1,
+  CSIM_STORE = 2,
+  CSIM_MODIFY = 3,
+} csim_kind_t;
+
+typedef struct csim_config {
+  size_t s; // set index bits
+  size_t e; // associativity
+  size_t b; // block bits
+  const char *policy;   // "lru", "fifo", "random", "plru", "srrip",
+                        // "brrip" or "lfu"
+  bool write_back;      // stores stay in the cache until evicted
+  bool write_allocate;  // store misses load the block
+  bool split_unaligned; // simulate every block an access touches
+  unsigned long long seed; // random and BRRIP
+  size_t victim_entries;   // fully associative victim cache, 0 for none
+} csim_config_t;
+
+typedef struct csim_access {
+  uint64_t address;
+  uint32_t size;
+  csim_kind_t kind;
+} csim_access_t;
+
+typedef struct csim_stats {
+  unsigned long long hits;
+  unsigned long long misses;
+  unsigned long long evictions;
+  unsigned long long dirty_evictions;
+  unsigned long long bytes_read;    // from the next level
+  unsigned long long bytes_written; // to the next level
+  unsigned long long victim_hits;
+} csim_stats_t;
+
+/* The csim defaults: LRU, write-back, write-allocate, no victim cache, and
+   like csim-ref each access is one block, however many it straddles */
+csim_config_t csim_default_config(void);
+
+/* Returns NULL if config does not describe a cache csim can simulate, or
+   if there is not enough memory for it */
+csim_t *csim_create(const csim_config_t *config);
+void csim_destroy(csim_t *sim);
+
+void csim_access(csim_t *sim, csim_kind_t kind, uint64_t address,
+                 uint32_t size);
+
+/* One access of the given kind and size per address, in order */
+void csim_access_batch(csim_t *sim, csim_kind_t kind,
+                       const uint64_t *addresses, size_t count,
+                       uint32_t size);
+void csim_access_records(csim_t *sim, const csim_access_t *accesses,
+                         size_t count);
+
+void csim_get_stats(const csim_t *sim, csim_stats_t *stats);
+
+/* Empty the cache and zero the counters; returns 0, or -1 (leaving sim
+   as it was) if there is not enough memory for the new cache */
+int csim_reset(csim_t *sim);
+/* Zero the counters but keep the cache contents, e.g. after a warm-up */
+void csim_reset_stats(csim_t *sim);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* LIBCSIM_H */
@@ -0,0 +1,39 @@
+/*
+ * trace2bin.c - Convert a valgrind text trace into csim's binary format
+ *
+ * usage: trace2bin <tracefile> <binfile>
+ *
+ * The result replays with csim -T <binfile> and gives identical results to
+ * csim -t <tracefile>. Lines that are not memory accesses are dropped.
+ */
+#include "csim-trace.h"
+#include <stdio.h>
+#include <stdlib.h>
+
+int main(int argc, char *argv[]) {
+  if (argc != 3) {
+    fprintf(stderr, "Usage: %s <tracefile> <binfile>\n", argv[0]);
+    exit(EXIT_FAILURE);
+  }
+
+  trace_reader_t reader;
+  trace_writer_t writer;
+  open_trace_reader(&reader, argv[1], TRACE_TEXT);
+  open_trace_writer(&writer, argv[2]);
+
+  trace_record_t *batch = calloc(TRACE_BATCH_SIZE, sizeof(trace_record_t));
+  if (!batch) {
+    perror("batch calloc failure");
+    exit(EXIT_FAILURE);
+  }
+  size_t count;
+
+  while ((count = read_trace_batch(&reader, batch, TRACE_BATCH_SIZE)) > 0)
+    for (size_t i = 0; i < count; i++)
+      write_trace_record(&writer, &batch[i]);
+
+  free(batch);
+  close_trace_reader(&reader);
+  close_trace_writer(&writer);
+  return 0;
+}
@@ -0,0 +1,121 @@
+/*
+ * transsim.c - Evaluate the registered transpose functions in-process
+ *
+ * usage: transsim -M <rows> -N <cols> [-F <func>] [-s <s> -E <E> -b <b>]
+ *
+ * The counterpart of tracegen + test-trans without valgrind: trans.c is
+ * built with -fsanitize=thread so its loads and stores reach csim-shim,
+ * which feeds them straight to a libcsim simulator. Each function runs
+ * once, between csim_shim_start and csim_shim_stop as tracegen's markers
+ * bound it, and is then checked against correctTrans. The cache defaults
+ * to the one test-trans grades with (s=5, E=1, b=5).
+ */
+#include "cachelab.h"
+#include "csim-shim.h"
+#include <stdbool.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+#define MAXN 256
+
+extern trans_func_t func_list[MAX_TRANS_FUNCS];
+extern int func_counter;
+
+extern void registerFunctions();
+
+static int A[MAXN][MAXN];
+static int B[MAXN][MAXN];
+static int C[MAXN][MAXN];
+
+static void usage(char *argv[]) {
+  fprintf(stderr,
+          "Usage: %s -M <rows> -N <cols> [-F <func>] "
+          "[-s <s> -E <E> -b <b>]\n",
+          argv[0]);
+  exit(EXIT_FAILURE);
+}
+
+static bool is_correct(int M, int N) {
+  memset(C, 0, sizeof(C));
+  correctTrans(M, N, (int(*)[M])A, (int(*)[N])C);
+  for (int i = 0; i < M; i++)
+    if (memcmp(((int(*)[N])B)[i], ((int(*)[N])C)[i], N * sizeof(int)) != 0)
+      return false;
+  return true;
+}
+
+int main(int argc, char *argv[]) {
+  int M = 0, N = 0, selected = -1;
+  csim_config_t config = csim_default_config();
+  config.s = 5;
+  config.e = 1;
+  config.b = 5;
+
+  int c;
+  while ((c = getopt(argc, argv, "M:N:F:s:E:b:")) != -1) {
+    switch (c) {
+    case 'M':
+      M = atoi(optarg);
+      break;
+    case 'N':
+      N = atoi(optarg);
+      break;
+    case 'F':
+      selected = atoi(optarg);
+      break;
+    case 's':
+      config.s = atoi(optarg);
+      break;
+    case 'E':
+      config.e = atoi(optarg);
+      break;
+    case 'b':
+      config.b = atoi(optarg);
+      break;
+    default:
+      usage(argv);
+    }
+  }
+  if (M <= 0 || N <= 0 || M > MAXN || N > MAXN)
+    usage(argv);
+
+  csim_t *sim = csim_create(&config);
+  if (!sim) {
+    fprintf(stderr, "bad cache s=%zu E=%zu b=%zu\n", config.s, config.e,
+            config.b);
+    exit(EXIT_FAILURE);
+  }
+
+  registerFunctions();
+  if (selected >= func_counter) {
+    fprintf(stderr, "no transpose function %d\n", selected);
+    exit(EXIT_FAILURE);
+  }
+  initMatrix(M, N, (int(*)[M])A, (int(*)[N])B);
+  csim_shim_attach(sim);
+
+  for (int i = 0; i < func_counter; i++) {
+    if (selected != -1 && i != selected)
+      continue;
+
+    if (csim_reset(sim) != 0) {
+      fprintf(stderr, "out of memory for the cache\n");
+      exit(EXIT_FAILURE);
+    }
+    csim_shim_start();
+    func_list[i].func_ptr(M, N, (int(*)[M])A, (int(*)[N])B);
+    csim_shim_stop();
+
+    csim_stats_t stats;
+    csim_get_stats(sim, &stats);
+    printf("func %d (%s): %s hits:%llu, misses:%llu, evictions:%llu\n", i,
+           func_list[i].description, is_correct(M, N) ? "correct" : "WRONG",
+           stats.hits, stats.misses, stats.evictions);
+  }
+
+  csim_shim_attach(NULL);
+  csim_destroy(sim);
+  return 0;
+}